@@ -2,8 +2,18 @@
 
 in vec4 fragPos;
 
+//Per-frame constants, shared by every program, must match FrameData in the renderer
+layout (std140, binding = 0) uniform FrameData {
+  mat4 viewMatrix;
+  mat4 projectionMatrix;
+  mat4 viewProjectionMatrix;
+  vec4 ambientLight;
+  vec4 cameraPos;
+  float farPlane;
+  int lightCount;
+};
+
 uniform vec3 lightPos;
-uniform float farPlane;
 
 void main() {
   float lightDistance = distance(fragPos.xyz, lightPos);
@@ -3,7 +3,11 @@
 layout (triangles) in;
 layout (triangle_strip, max_vertices = 18) out;
 
-uniform mat4 shadowMatrices[6];
+//Shadow transforms from shader storage buffer, 6 for each light
+layout (std430, binding = 3) readonly buffer ShadowTransformBuffer {
+  mat4 shadowMatrices[];
+};
+
 uniform int shadowMapIndex;
 
 out vec4 fragPos;
@@ -15,7 +19,7 @@ void main() {
 
     for (int i = 0; i < 3; i++) {
       fragPos = gl_in[i].gl_Position;
-      gl_Position = shadowMatrices[face] * fragPos;
+      gl_Position = shadowMatrices[(shadowMapIndex * 6) + face] * fragPos;
 
       EmitVertex();
     }
@@ -2,9 +2,22 @@
 
 layout (location = 0) in vec3 inPosition;
 
-uniform mat4 modelMatrix;
+//Node transform, also dequantises compact positions
+layout (location = 3) in mat4 instanceMatrix;
+
+//Per-draw data, indexed by drawIndex, must match DrawData in the renderer
+struct DrawData {
+  mat4 modelMatrix;
+  mat4 normalMatrix;
+};
+
+layout (std430, binding = 2) readonly buffer DrawBuffer {
+  DrawData drawData[];
+};
+
+uniform uint drawIndex;
 
 void main() {
-  //Output position, in model space
-  gl_Position = modelMatrix * vec4(inPosition, 1);
+  //Output position, in model space, the instance matrix also dequantises compact positions
+  gl_Position = drawData[drawIndex].modelMatrix * instanceMatrix * vec4(inPosition, 1);
 }
@@ -1,9 +1,35 @@
 #version 430 core
 
 layout (location = 0) in vec3 inPosition;
-uniform mat4 MVP;
+
+//Node transform, also dequantises compact positions
+layout (location = 3) in mat4 instanceMatrix;
+
+//Per-frame constants, shared by every program, must match FrameData in the renderer
+layout (std140, binding = 0) uniform FrameData {
+  mat4 viewMatrix;
+  mat4 projectionMatrix;
+  mat4 viewProjectionMatrix;
+  vec4 ambientLight;
+  vec4 cameraPos;
+  float farPlane;
+  int lightCount;
+};
+
+//Per-draw data, indexed by drawIndex, must match DrawData in the renderer
+struct DrawData {
+  mat4 modelMatrix;
+  mat4 normalMatrix;
+};
+
+layout (std430, binding = 2) readonly buffer DrawBuffer {
+  DrawData drawData[];
+};
+
+uniform uint drawIndex;
 
 void main() {
-  //Output position of the vertex
-  gl_Position = MVP * vec4(inPosition, 1);
+  //Output position of the vertex, the instance matrix also dequantises compact positions
+  mat4 modelMatrix = drawData[drawIndex].modelMatrix;
+  gl_Position = viewProjectionMatrix * modelMatrix * instanceMatrix * vec4(inPosition, 1);
 }
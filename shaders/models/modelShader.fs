@@ -18,11 +18,36 @@ struct LightSource {
   float power;
 };
 
+//Texture pool and layer for each material
+struct Material {
+  uint pool;
+  uint layer;
+};
+
 //Lighting inputs from shader storage buffer
 layout (std430, binding = 0) readonly buffer LightPropertiesBuffer {
   RawLightSource lightSources[];
 };
 
+//Material inputs from shader storage buffer, material 0 is untextured
+layout (std430, binding = 1) readonly buffer MaterialBuffer {
+  Material materials[];
+};
+
+//Per-frame constants, shared by every program, must match FrameData in the renderer
+layout (std140, binding = 0) uniform FrameData {
+  mat4 viewMatrix;
+  mat4 projectionMatrix;
+  mat4 viewProjectionMatrix;
+  vec4 ambientLight;
+  vec4 cameraPos;
+  float farPlane;
+  int lightCount;
+};
+
+//Must match MAX_TEXTURE_POOLS in the engine
+#define MAX_TEXTURE_POOLS 12
+
 //Input fragment data, from vertex shader
 in FragmentDataOut {
   vec3 fragPos;
@@ -34,12 +59,16 @@ in FragmentDataOut {
 out vec3 outputColour;
 
 //Engine inputs
-uniform sampler2D textureSampler;
+uniform sampler2DArray texturePools[MAX_TEXTURE_POOLS];
+uniform uint materialIndex;
 uniform samplerCubeArrayShadow shadowCubeMap;
-uniform vec3 ambientLight;
-uniform vec3 cameraPos;
-uniform float farPlane;
-uniform int lightCount;
+
+//Variants can fix the light count, so the light loop can be unrolled
+#ifdef LIGHT_COUNT
+  #define ACTIVE_LIGHTS LIGHT_COUNT
+#else
+  #define ACTIVE_LIGHTS lightCount
+#endif
 
 float calcShadow(int layer, vec3 fragPos, vec3 lightPos) {
   //Get depth of current fragment
@@ -58,7 +87,7 @@ vec3 calcLight(LightSource lightSource, vec3 normal, vec3 fragPos, vec3 lightDir
     //Specular component
     vec3 specular = vec3(0.0f);
     if (diff > 0.0f) {
-      vec3 viewDir = normalize(cameraPos - fragPos);
+      vec3 viewDir = normalize(cameraPos.xyz - fragPos);
       vec3 halfwayDir = normalize(lightDir + viewDir);
       float spec = pow(clamp(dot(normal, halfwayDir), 0.0, 1.0), 2.0);
       vec3 specular = lightSource.specular * spec * lightSource.colour;
@@ -72,13 +101,25 @@ vec3 calcLight(LightSource lightSource, vec3 normal, vec3 fragPos, vec3 lightDir
 }
 
 void main() {
-  //Base colour of the fragment
-  vec3 materialColour = texture(textureSampler, fragData.texCoord).rgb;
+#ifdef UNTEXTURED
+  //Untextured materials have no base colour, so no light is reflected
+  outputColour = vec3(0.0f);
+#else
+  //Base colour of the fragment, the material index is the same for the whole draw
+  vec3 materialColour = vec3(0.0f);
+  if (materialIndex != 0u) {
+    //Evicted textures have no pool until they're reloaded
+    Material material = materials[materialIndex];
+    if (material.pool < uint(MAX_TEXTURE_POOLS)) {
+      vec3 texCoord = vec3(fragData.texCoord, material.layer);
+      materialColour = texture(texturePools[material.pool], texCoord).rgb;
+    }
+  }
   vec3 lightColour = vec3(0.0f, 0.0f, 0.0f);
 
   //Calculate lighting influence from each light source
   LightSource lightSource;
-  for (int i = 0; i < lightCount; i++) {
+  for (int i = 0; i < ACTIVE_LIGHTS; i++) {
     lightSource.geometry = lightSources[i].geometry.xyz;
     lightSource.colour = lightSources[i].colour.xyz;
     lightSource.diffuse = lightSources[i].diffuse.xyz;
@@ -94,5 +135,6 @@ void main() {
   }
 
   //Final fragment colour, from ambient, diffuse, specular and shadow components
-  outputColour = (ambientLight + lightColour) * materialColour;
+  outputColour = (ambientLight.xyz + lightColour) * materialColour;
+#endif
 }
@@ -1,9 +1,14 @@
 #version 430 core
 
-layout (location = 0) in vec3 inPosition;
+//Compact positions store 0 in w, full precision positions read the default of 1
+layout (location = 0) in vec4 inPosition;
 layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 vertexTexCoord;
 
+//Node transform, also dequantises compact positions
+layout (location = 3) in mat4 instanceMatrix;
+layout (location = 7) in mat3 instanceNormalMatrix;
+
 //Output fragment data, sent to fragment shader
 out FragmentDataOut {
   vec3 fragPos;
@@ -11,20 +16,56 @@ out FragmentDataOut {
   vec2 texCoord;
 } fragData;
 
-uniform mat4 MVP;
-uniform mat4 modelMatrix;
-uniform mat3 normalMatrix;
+//Per-frame constants, shared by every program, must match FrameData in the renderer
+layout (std140, binding = 0) uniform FrameData {
+  mat4 viewMatrix;
+  mat4 projectionMatrix;
+  mat4 viewProjectionMatrix;
+  vec4 ambientLight;
+  vec4 cameraPos;
+  float farPlane;
+  int lightCount;
+};
+
+//Per-draw data, indexed by drawIndex, must match DrawData in the renderer
+struct DrawData {
+  mat4 modelMatrix;
+  mat4 normalMatrix;
+};
+
+layout (std430, binding = 2) readonly buffer DrawBuffer {
+  DrawData drawData[];
+};
+
+uniform uint drawIndex;
+
+vec3 decodeOctahedral(vec2 encoded) {
+  vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+  float fold = max(-normal.z, 0.0);
+  normal.x += (normal.x >= 0.0) ? -fold : fold;
+  normal.y += (normal.y >= 0.0) ? -fold : fold;
+  return normal;
+}
 
 void main() {
+  //Apply the node transform, which also dequantises compact positions
+  vec4 position = instanceMatrix * vec4(inPosition.xyz, 1);
+
   //Position of the vertex, in worldspace
-  fragData.fragPos = (modelMatrix * vec4(inPosition, 1)).xyz;
+  vec4 worldPosition = drawData[drawIndex].modelMatrix * position;
+  fragData.fragPos = worldPosition.xyz;
 
   //Vertex normal
-  fragData.normal = normalize(normalMatrix * inNormal);
+  vec3 normal = inNormal;
+  if (inPosition.w == 0.0) {
+    normal = decodeOctahedral(inNormal.xy);
+  }
+  mat3 normalMatrix = mat3(drawData[drawIndex].normalMatrix);
+  fragData.normal = normalize(normalMatrix * (instanceNormalMatrix * normal));
 
   //Vertex texture coord
   fragData.texCoord = vertexTexCoord;
 
   //Output position of the vertex
-  gl_Position = MVP * vec4(inPosition, 1);
+  gl_Position = viewProjectionMatrix * worldPosition;
 }
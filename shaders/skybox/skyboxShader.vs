@@ -4,10 +4,20 @@ layout (location = 0) in vec3 inPosition;
 
 out vec3 texCoords;
 
-uniform mat4 viewMatrix;
-uniform mat4 projectionMatrix;
+//Per-frame constants, shared by every program, must match FrameData in the renderer
+layout (std140, binding = 0) uniform FrameData {
+  mat4 viewMatrix;
+  mat4 projectionMatrix;
+  mat4 viewProjectionMatrix;
+  vec4 ambientLight;
+  vec4 cameraPos;
+  float farPlane;
+  int lightCount;
+};
 
 void main() {
   texCoords = inPosition;
-  gl_Position = (projectionMatrix * viewMatrix * vec4(inPosition, 1.0)).xyww;
+  //Remove the translation from the view matrix, so the skybox stays centred on the camera
+  mat4 skyboxViewMatrix = mat4(mat3(viewMatrix));
+  gl_Position = (projectionMatrix * skyboxViewMatrix * vec4(inPosition, 1.0)).xyww;
 }
@@ -6,6 +6,7 @@
 #include "utils/extension.hpp"
 #include "utils/controls.hpp"
 #include "utils/cacheManager.hpp"
+#include "utils/profiler.hpp"
 
 #ifdef DEBUG
   #include "utils/debug.hpp"
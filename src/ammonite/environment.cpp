@@ -6,6 +6,7 @@
 #include <GL/glew.h>
 
 #include "internal/textures.hpp"
+#include "internal/renderStats.hpp"
 #include "utils/logging.hpp"
 
 #include "internal/internalDebug.hpp"
@@ -76,6 +77,7 @@ namespace ammonite {
           //Fill the texture with each face
           if (imageData) {
             glTextureSubImage3D(textureId, 0, 0, 0, i, width, height, 1, dataFormat, GL_UNSIGNED_BYTE, imageData);
+            ammonite::renderStats::countTextureUpload((long long)width * height * nChannels);
             stbi_image_free(imageData);
           } else {
             //Free image data, destroy texture, set failure and return
@@ -0,0 +1,83 @@
+#include <iostream>
+#include <filesystem>
+#include <string>
+#include <map>
+#include <cstdio>
+
+#include "assetRegistry.hpp"
+#include "fileManager.hpp"
+#include "../utils/profiler.hpp"
+
+#include "internalDebug.hpp"
+
+namespace ammonite {
+  namespace registry {
+    namespace {
+      //Hash of a file's contents, valid while its size and modification time match
+      struct FileHash {
+        long long int filesize;
+        long long int timestamp;
+        unsigned long long int hash;
+      };
+
+      std::map<std::string, FileHash> fileHashMap;
+      int requestCounts[2] = {0, 0};
+      int reuseCounts[2] = {0, 0};
+    }
+
+    /*
+     - Return a key identifying the file's contents and the options used to load it
+     - Files are only read again if their canonical path's metadata changed
+     - If the file can't be read, the path is used so the loader can report the error
+     - Files that load others relative to themselves (materials, textures) also key on their directory,
+       so identical files next to different dependencies aren't shared
+    */
+    std::string getAssetKey(const char* filePath, unsigned int loadOptions, bool hasRelativeDependencies) {
+      std::error_code error;
+      std::string canonicalPath = std::filesystem::weakly_canonical(filePath, error).string();
+      if (error) {
+        canonicalPath = std::string(filePath);
+      }
+
+      std::string directoryKey;
+      if (hasRelativeDependencies) {
+        directoryKey = ";" + std::filesystem::path(canonicalPath).parent_path().string();
+      }
+
+      long long int filesize, timestamp;
+      if (!ammonite::utils::files::getFileMetadata(canonicalPath.c_str(), &filesize, &timestamp)) {
+        return std::string(filePath) + ";" + std::to_string(loadOptions) + directoryKey;
+      }
+
+      auto it = fileHashMap.find(canonicalPath);
+      if (it == fileHashMap.end() or it->second.filesize != filesize or it->second.timestamp != timestamp) {
+        unsigned long long int hash;
+        if (!ammonite::utils::files::hashFile(canonicalPath.c_str(), &hash)) {
+          return std::string(filePath) + ";" + std::to_string(loadOptions) + directoryKey;
+        }
+
+        fileHashMap[canonicalPath] = {filesize, timestamp, hash};
+        ammoniteInternalDebug << "Hashed '" << canonicalPath << "'" << std::endl;
+      }
+
+      char hashString[17];
+      std::snprintf(hashString, sizeof(hashString), "%016llx", fileHashMap[canonicalPath].hash);
+      return std::string(hashString) + ";" + std::to_string(loadOptions) + directoryKey;
+    }
+
+    void recordRequest(AssetType assetType, bool isReused) {
+      requestCounts[assetType]++;
+      if (isReused) {
+        reuseCounts[assetType]++;
+        ammoniteProfileInstant(assetType == MODEL_ASSET ? "Model reuse hit" : "Texture reuse hit");
+      } else {
+        ammoniteProfileInstant(assetType == MODEL_ASSET ? "Model reuse miss" : "Texture reuse miss");
+      }
+    }
+
+    void getRequestStats(AssetType assetType, int* requestCount, int* reuseCount) {
+      *requestCount = requestCounts[assetType];
+      *reuseCount = reuseCounts[assetType];
+    }
+  }
+}
@@ -0,0 +1,24 @@
+#ifndef INTERNALASSETREGISTRY
+#define INTERNALASSETREGISTRY
+
+#include <string>
+
+/* Internally exposed header:
+ - Allow models and textures to be deduplicated by their contents
+ - Allow tracking how often loaded assets are reused
+*/
+
+namespace ammonite {
+  namespace registry {
+    enum AssetType {
+      MODEL_ASSET = 0,
+      TEXTURE_ASSET = 1
+    };
+
+    std::string getAssetKey(const char* filePath, unsigned int loadOptions, bool hasRelativeDependencies);
+    void recordRequest(AssetType assetType, bool isReused);
+    void getRequestStats(AssetType assetType, int* requestCount, int* reuseCount);
+  }
+}
+
+#endif
@@ -0,0 +1,286 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "cacheArchive.hpp"
+#include "fileManager.hpp"
+#include "../utils/logging.hpp"
+
+#include "internalDebug.hpp"
+
+namespace ammonite {
+  namespace utils {
+    namespace cache {
+      namespace archive {
+        namespace {
+          /*
+           - The archive is a header, followed by records that are only ever appended
+           - Each record holds a key for its inputs, then the binary, aligned to ARCHIVE_ALIGNMENT
+           - Keys come from the input contents, so records stay valid if the inputs are moved
+           - Later records for the same key replace earlier ones, which are compacted away
+          */
+          const char ARCHIVE_MAGIC[8] = {'A', 'M', 'M', 'C', 'A', 'C', 'H', 'E'};
+          const unsigned int RECORD_MAGIC = 0x52434D41;
+          const unsigned int ARCHIVE_VERSION = 2;
+          const unsigned long long int ARCHIVE_ALIGNMENT = 16;
+
+          struct ArchiveHeader {
+            char magic[8];
+            unsigned int version;
+            unsigned int reserved;
+          };
+
+          struct RecordHeader {
+            unsigned int magic;
+            unsigned int binaryFormat;
+            unsigned long long int key;
+            unsigned long long int binarySize;
+            unsigned long long int reserved;
+          };
+
+          //Records either point into the mapped archive, or own a copy stored this run
+          struct ArchiveEntry {
+            const char* record;
+            std::vector<char> ownedRecord;
+          };
+
+          std::string archiveFilePath;
+          const char* archiveData = nullptr;
+          unsigned long long int archiveSize = 0;
+          std::unordered_map<unsigned long long int, ArchiveEntry> archiveEntries;
+        }
+
+        namespace {
+          static unsigned long long int alignSize(unsigned long long int size) {
+            return (size + ARCHIVE_ALIGNMENT - 1) & ~(ARCHIVE_ALIGNMENT - 1);
+          }
+
+          static unsigned long long int getRecordSize(const RecordHeader* recordHeader) {
+            return sizeof(RecordHeader) + alignSize(recordHeader->binarySize);
+          }
+
+          //Check a record's bounds, without trusting any of its sizes
+          static bool checkRecord(const char* record, unsigned long long int remaining) {
+            if (remaining < sizeof(RecordHeader)) {
+              return false;
+            }
+
+            const RecordHeader* recordHeader = (const RecordHeader*)record;
+            return recordHeader->magic == RECORD_MAGIC and recordHeader->binarySize <= remaining and
+                   getRecordSize(recordHeader) <= remaining;
+          }
+
+          static void unmapArchive() {
+            if (archiveData != nullptr) {
+              munmap((void*)archiveData, archiveSize);
+            }
+
+            archiveData = nullptr;
+            archiveSize = 0;
+            archiveEntries.clear();
+          }
+
+          static bool mapArchive() {
+            int fileDescriptor = open(archiveFilePath.c_str(), O_RDONLY);
+            if (fileDescriptor == -1) {
+              return false;
+            }
+
+            struct stat fileInfo;
+            if (fstat(fileDescriptor, &fileInfo) != 0 or fileInfo.st_size < (off_t)sizeof(ArchiveHeader)) {
+              close(fileDescriptor);
+              return false;
+            }
+
+            void* mappedData = mmap(nullptr, fileInfo.st_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+            close(fileDescriptor);
+            if (mappedData == MAP_FAILED) {
+              return false;
+            }
+
+            archiveData = (const char*)mappedData;
+            archiveSize = fileInfo.st_size;
+            return true;
+          }
+
+          //Write a header and the given records to a new archive, then swap it in
+          static bool writeArchive(std::vector<const char*>* records) {
+            std::string tempFilePath = archiveFilePath + ".tmp";
+            std::ofstream output(tempFilePath, std::ios::binary | std::ios::trunc);
+            if (!output.is_open()) {
+              return false;
+            }
+
+            ArchiveHeader header;
+            std::memcpy(header.magic, ARCHIVE_MAGIC, sizeof(header.magic));
+            header.version = ARCHIVE_VERSION;
+            header.reserved = 0;
+            output.write((char*)&header, sizeof(header));
+
+            for (unsigned int i = 0; i < records->size(); i++) {
+              const char* record = (*records)[i];
+              output.write(record, getRecordSize((const RecordHeader*)record));
+            }
+
+            output.close();
+            if (!output or std::rename(tempFilePath.c_str(), archiveFilePath.c_str()) != 0) {
+              ammonite::utils::files::deleteFile(tempFilePath);
+              return false;
+            }
+
+            return true;
+          }
+
+          /*
+           - Index every valid record in the mapped archive
+           - Returns the number of bytes that aren't used by an indexed record
+           - Damaged archives must be rewritten, as appended records would be unreachable
+          */
+          static unsigned long long int indexArchive(bool* isDamaged) {
+            *isDamaged = false;
+            const ArchiveHeader* header = (const ArchiveHeader*)archiveData;
+            if (std::memcmp(header->magic, ARCHIVE_MAGIC, sizeof(header->magic)) != 0 or
+                header->version != ARCHIVE_VERSION) {
+              *isDamaged = true;
+              return archiveSize;
+            }
+
+            unsigned long long int unusedBytes = 0;
+            unsigned long long int offset = sizeof(ArchiveHeader);
+            while (offset < archiveSize) {
+              const char* record = archiveData + offset;
+              if (!checkRecord(record, archiveSize - offset)) {
+                //A partly written record, ignore the rest of the archive
+                unusedBytes += archiveSize - offset;
+                *isDamaged = true;
+                break;
+              }
+
+              const RecordHeader* recordHeader = (const RecordHeader*)record;
+              unsigned long long int recordSize = getRecordSize(recordHeader);
+              offset += recordSize;
+
+              //Replace any older record for the same key
+              auto entryIt = archiveEntries.find(recordHeader->key);
+              if (entryIt != archiveEntries.end()) {
+                unusedBytes += getRecordSize((const RecordHeader*)entryIt->second.record);
+                entryIt->second.record = record;
+              } else {
+                archiveEntries[recordHeader->key].record = record;
+              }
+            }
+
+            return unusedBytes;
+          }
+        }
+
+        /*
+         - Map the archive and index it, creating it if it doesn't exist
+         - Replaced, broken or partly written records are compacted away when they
+           outweigh the valid records
+        */
+        bool openArchive(std::string archivePath) {
+          unmapArchive();
+          archiveFilePath = archivePath;
+
+          unsigned long long int unusedBytes = 0;
+          bool isDamaged = true;
+          if (mapArchive()) {
+            unusedBytes = indexArchive(&isDamaged);
+          }
+
+          //Create a new archive, or compact the existing one
+          if (isDamaged or unusedBytes * 2 > archiveSize) {
+            std::vector<const char*> records;
+            for (auto entryIt = archiveEntries.begin(); entryIt != archiveEntries.end(); entryIt++) {
+              records.push_back(entryIt->second.record);
+            }
+
+            bool hasWrittenArchive = writeArchive(&records);
+            unmapArchive();
+            if (!hasWrittenArchive or !mapArchive()) {
+              std::cerr << ammonite::utils::warning << "Failed to create '" << archiveFilePath << "'" << std::endl;
+              archiveFilePath = "";
+              return false;
+            }
+
+            indexArchive(&isDamaged);
+            if (unusedBytes != 0) {
+              ammoniteInternalDebug << "Compacted '" << archiveFilePath << "', removed "
+                                    << unusedBytes << " bytes" << std::endl;
+            }
+          }
+
+          ammoniteInternalDebug << "Indexed " << archiveEntries.size() << " cached binaries from '"
+                                << archiveFilePath << "'" << std::endl;
+          return true;
+        }
+
+        void closeArchive() {
+          unmapArchive();
+          archiveFilePath = "";
+        }
+
+        //Return the cached binary for the key, or nullptr if there isn't one
+        const char* findBinary(unsigned long long int key, unsigned int* binaryFormat,
+                               unsigned long long int* binarySize) {
+          auto entryIt = archiveEntries.find(key);
+          if (entryIt == archiveEntries.end()) {
+            return nullptr;
+          }
+
+          const RecordHeader* recordHeader = (const RecordHeader*)entryIt->second.record;
+          *binaryFormat = recordHeader->binaryFormat;
+          *binarySize = recordHeader->binarySize;
+          return entryIt->second.record + sizeof(RecordHeader);
+        }
+
+        /*
+         - Append a binary to the archive with a single write, so a crash can't damage older records
+         - The record is kept in memory too, so it can be found again before the archive is reopened
+        */
+        bool storeBinary(unsigned long long int key, unsigned int binaryFormat,
+                         const char* binaryData, unsigned long long int binarySize) {
+          if (archiveFilePath == "") {
+            return false;
+          }
+
+          RecordHeader recordHeader = {RECORD_MAGIC, binaryFormat, key, binarySize, 0};
+          std::vector<char> record(getRecordSize(&recordHeader), 0);
+          std::memcpy(record.data(), &recordHeader, sizeof(recordHeader));
+          std::memcpy(record.data() + sizeof(RecordHeader), binaryData, binarySize);
+
+          int fileDescriptor = open(archiveFilePath.c_str(), O_WRONLY | O_APPEND);
+          if (fileDescriptor == -1) {
+            return false;
+          }
+
+          ssize_t writtenSize = write(fileDescriptor, record.data(), record.size());
+          close(fileDescriptor);
+          if (writtenSize != (ssize_t)record.size()) {
+            std::cerr << ammonite::utils::warning << "Failed to write to '" << archiveFilePath << "'" << std::endl;
+            return false;
+          }
+
+          ArchiveEntry* entry = &archiveEntries[key];
+          entry->ownedRecord.swap(record);
+          entry->record = entry->ownedRecord.data();
+          return true;
+        }
+
+        //Forget a faulty binary, a replacement stored later takes its place in the archive
+        void removeBinary(unsigned long long int key) {
+          archiveEntries.erase(key);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,28 @@
+#ifndef INTERNALCACHEARCHIVE
+#define INTERNALCACHEARCHIVE
+
+#include <string>
+
+/* Internally exposed header:
+ - Allow the cache manager to map a single archive of cached binaries
+ - Allow shaders to look up and store program binaries by a key of their inputs
+*/
+
+namespace ammonite {
+  namespace utils {
+    namespace cache {
+      namespace archive {
+        bool openArchive(std::string archivePath);
+        void closeArchive();
+
+        const char* findBinary(unsigned long long int key, unsigned int* binaryFormat,
+                               unsigned long long int* binarySize);
+        bool storeBinary(unsigned long long int key, unsigned int binaryFormat,
+                         const char* binaryData, unsigned long long int binarySize);
+        void removeBinary(unsigned long long int key);
+      }
+    }
+  }
+}
+
+#endif
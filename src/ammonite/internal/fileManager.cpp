@@ -1,5 +1,8 @@
 #include <sys/stat.h>
 #include <filesystem>
+#include <fstream>
+#include <vector>
+#include <cstring>
 #include <string>
 
 #include "internalDebug.hpp"
@@ -7,6 +10,31 @@
 namespace ammonite {
   namespace utils {
     namespace files {
+      namespace {
+        const unsigned long long int HASH_PRIME = 0x9e3779b97f4a7c15ULL;
+        const std::streamsize HASH_CHUNK_SIZE = 64 * 1024;
+
+        //Scramble the bits of a word, so similar inputs give very different outputs
+        static unsigned long long int mixWord(unsigned long long int word) {
+          word ^= word >> 33;
+          word *= 0xff51afd7ed558ccdULL;
+          word ^= word >> 33;
+          return word;
+        }
+
+        //Fold a block of data into the hash state, the block must have room to pad the last word
+        static void hashBlock(char* data, std::streamsize size, unsigned long long int* state) {
+          //Zero the end of a partial word, then fold every word into the state
+          std::memset(data + size, 0, (8 - (size % 8)) % 8);
+          for (std::streamsize offset = 0; offset < size; offset += 8) {
+            unsigned long long int word;
+            std::memcpy(&word, data + offset, sizeof(word));
+            *state = (*state ^ mixWord(word)) * HASH_PRIME;
+            *state = (*state << 27) | (*state >> 37);
+          }
+        }
+      }
+
       void deleteFile(std::string filePath) {
         if (std::filesystem::exists(filePath)) {
           std::remove(filePath.c_str());
@@ -25,6 +53,42 @@ namespace ammonite {
         *filesize = fileInfo.st_size;
        return true;
       }
+
+      //Hash a file's contents 8 bytes at a time, for identifying files, not security
+      bool hashFile(const char* filePath, unsigned long long int* hash) {
+        std::ifstream input(filePath, std::ios::binary);
+        if (!input.is_open()) {
+          return false;
+        }
+
+        unsigned long long int state = HASH_PRIME;
+        unsigned long long int totalSize = 0;
+        std::vector<char> buffer(HASH_CHUNK_SIZE);
+        while (input) {
+          input.read(buffer.data(), HASH_CHUNK_SIZE);
+          std::streamsize readSize = input.gcount();
+          totalSize += readSize;
+          hashBlock(buffer.data(), readSize, &state);
+        }
+
+        if (input.bad()) {
+          return false;
+        }
+
+        //Include the length, so trailing zeros change the hash
+        *hash = mixWord(state ^ mixWord(totalSize));
+        return true;
+      }
+
+      //Hash data in memory, matching hashFile() for the same bytes
+      unsigned long long int hashData(const void* data, unsigned long long int size) {
+        std::vector<char> buffer(size + 8);
+        std::memcpy(buffer.data(), data, size);
+
+        unsigned long long int state = HASH_PRIME;
+        hashBlock(buffer.data(), size, &state);
+        return mixWord(state ^ mixWord(size));
+      }
     }
   }
 }
@@ -10,6 +10,8 @@ namespace ammonite {
     namespace files {
       void deleteFile(std::string filePath);
       bool getFileMetadata(const char* filePath, long long int* filesize, long long int* timestamp);
+      bool hashFile(const char* filePath, unsigned long long int* hash);
+      unsigned long long int hashData(const void* data, unsigned long long int size);
     }
   }
 }
@@ -0,0 +1,172 @@
+#include <time.h>
+#include <cstdlib>
+#include <cerrno>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#include "framePacer.hpp"
+#include "../utils/profiler.hpp"
+
+#include "internalDebug.hpp"
+
+namespace ammonite {
+  namespace pacing {
+    namespace {
+      const long long int NANOSECONDS_PER_SECOND = 1000000000;
+
+      //Limits and starting value for the time spent spinning before a deadline
+      const long long int MIN_SPIN_MARGIN = 20000;
+      const long long int MAX_SPIN_MARGIN = 2000000;
+      const long long int INITIAL_SPIN_MARGIN = 200000;
+
+      /*
+       - Deadlines are counted from an anchor, so rounding never accumulates
+       - The anchor moves if the limit changes, or a deadline is missed by over a frame
+      */
+      float anchorFrameLimit = 0.0f;
+      long long int anchorTime = 0;
+      long long int anchorFrames = 0;
+      long long int spinMargin = INITIAL_SPIN_MARGIN;
+
+      //Start of the last paced frame, 0 if the next frame has nothing to compare against
+      long long int lastFrameStart = 0;
+
+      //Statistics since the last reset, jitter is measured between frame starts
+      long long int statsStartTime = 0;
+      long long int statsStartCpuTime = 0;
+      long long int totalJitter = 0;
+      long long int maxFrameJitter = 0;
+      long long int totalLateness = 0;
+      long pacedFrames = 0;
+      long missedFrameDeadlines = 0;
+    }
+
+    namespace {
+      static long long int getClockTime(clockid_t clockId) {
+        timespec time;
+        clock_gettime(clockId, &time);
+        return (long long int)time.tv_sec * NANOSECONDS_PER_SECOND + time.tv_nsec;
+      }
+
+      static void sleepUntil(long long int deadline) {
+        timespec time;
+        time.tv_sec = deadline / NANOSECONDS_PER_SECOND;
+        time.tv_nsec = deadline % NANOSECONDS_PER_SECOND;
+
+        //Sleep again if a signal woke the thread early, give up on any other error
+        int result;
+        do {
+          result = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, nullptr);
+        } while (result == EINTR);
+      }
+
+      static void startStats() {
+        if (statsStartTime == 0) {
+          statsStartTime = getClockTime(CLOCK_MONOTONIC);
+          statsStartCpuTime = getClockTime(CLOCK_PROCESS_CPUTIME_ID);
+        }
+      }
+
+      //Record how far the gap since the last frame start strayed from the frame period
+      static void recordFrameStart(long long int frameStart, double framePeriod) {
+        if (lastFrameStart != 0) {
+          long long int jitter = std::llabs(frameStart - lastFrameStart - std::llround(framePeriod));
+          totalJitter += jitter;
+          maxFrameJitter = std::max(maxFrameJitter, jitter);
+          pacedFrames++;
+        }
+
+        lastFrameStart = frameStart;
+      }
+    }
+
+    /*
+     - Sleep to just before the next absolute deadline, then spin until it's reached
+     - The spin margin follows how late the sleeps wake, so spinning stays short
+    */
+    void waitForNextFrame(float frameLimit) {
+      ammoniteProfileZone("waitForNextFrame");
+      long long int currentTime = getClockTime(CLOCK_MONOTONIC);
+      if (frameLimit <= 0.0f) {
+        anchorFrameLimit = 0.0f;
+        lastFrameStart = 0;
+        return;
+      }
+
+      startStats();
+      const double framePeriod = double(NANOSECONDS_PER_SECOND) / frameLimit;
+
+      //Start counting frames from now when the limit changes
+      if (frameLimit != anchorFrameLimit) {
+        anchorFrameLimit = frameLimit;
+        anchorTime = currentTime;
+        anchorFrames = 0;
+        lastFrameStart = 0;
+      }
+
+      anchorFrames++;
+      long long int deadline = anchorTime + std::llround(anchorFrames * framePeriod);
+
+      //Missed the deadline, restart from now if it's too late to catch up
+      if (currentTime >= deadline) {
+        missedFrameDeadlines++;
+        totalLateness += currentTime - deadline;
+        if (currentTime - deadline > framePeriod) {
+          anchorTime = currentTime;
+          anchorFrames = 0;
+        }
+
+        recordFrameStart(currentTime, framePeriod);
+        return;
+      }
+
+      //Sleep until shortly before the deadline, then adjust the margin by how late the wake was
+      long long int sleepTarget = deadline - spinMargin;
+      if (sleepTarget > currentTime) {
+        sleepUntil(sleepTarget);
+        long long int oversleep = getClockTime(CLOCK_MONOTONIC) - sleepTarget;
+        spinMargin = std::clamp((spinMargin * 7 + oversleep * 2) / 8, MIN_SPIN_MARGIN, MAX_SPIN_MARGIN);
+      }
+
+      //Spin for the remaining time
+      do {
+        currentTime = getClockTime(CLOCK_MONOTONIC);
+      } while (currentTime < deadline);
+
+      recordFrameStart(currentTime, framePeriod);
+    }
+
+    /*
+     - Report jitter and the mean lateness of missed deadlines in seconds
+     - Report the process' CPU time as a fraction of wall time
+    */
+    void getPacingStats(double* meanJitter, double* maxJitter, long* missedDeadlines,
+                        double* meanLateness, double* cpuUsage) {
+      *meanJitter = (pacedFrames == 0) ? 0.0 : double(totalJitter) / pacedFrames / NANOSECONDS_PER_SECOND;
+      *maxJitter = double(maxFrameJitter) / NANOSECONDS_PER_SECOND;
+      *missedDeadlines = missedFrameDeadlines;
+      *meanLateness = (missedFrameDeadlines == 0) ? 0.0 :
+        double(totalLateness) / missedFrameDeadlines / NANOSECONDS_PER_SECOND;
+
+      *cpuUsage = 0.0;
+      if (statsStartTime != 0) {
+        long long int wallTime = getClockTime(CLOCK_MONOTONIC) - statsStartTime;
+        long long int cpuTime = getClockTime(CLOCK_PROCESS_CPUTIME_ID) - statsStartCpuTime;
+        if (wallTime > 0) {
+          *cpuUsage = double(cpuTime) / double(wallTime);
+        }
+      }
+    }
+
+    void resetPacingStats() {
+      statsStartTime = 0;
+      statsStartCpuTime = 0;
+      totalJitter = 0;
+      maxFrameJitter = 0;
+      totalLateness = 0;
+      pacedFrames = 0;
+      missedFrameDeadlines = 0;
+    }
+  }
+}
@@ -0,0 +1,19 @@
+#ifndef INTERNALFRAMEPACER
+#define INTERNALFRAMEPACER
+
+/* Internally exposed header:
+ - Allow the renderer to wait for the next frame's deadline
+ - Allow pacing statistics to be read and reset
+*/
+
+namespace ammonite {
+  namespace pacing {
+    void waitForNextFrame(float frameLimit);
+
+    void getPacingStats(double* meanJitter, double* maxJitter, long* missedDeadlines,
+                        double* meanLateness, double* cpuUsage);
+    void resetPacingStats();
+  }
+}
+
+#endif
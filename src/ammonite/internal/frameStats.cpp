@@ -0,0 +1,160 @@
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#include "frameStats.hpp"
+#include "../utils/timer.hpp"
+#include "../utils/logging.hpp"
+
+#include "internalDebug.hpp"
+
+namespace ammonite {
+  namespace frameStats {
+    namespace {
+      /*
+       - Frame times are counted in buckets that grow by 1% each, starting from 10 microseconds
+       - This keeps every frame since the last reset, with percentiles accurate to within 1%
+       - Anything over ~10 seconds lands in the last bucket, the exact maximum is kept separately
+      */
+      const double MIN_BUCKET_TIME = 0.00001;
+      const double BUCKET_GROWTH = 1.01;
+      const int BUCKET_COUNT = 1400;
+
+      long bucketCounts[BUCKET_COUNT] = {0};
+      long recordedFrames = 0;
+      double totalTime = 0.0;
+      double minFrameTime = 0.0;
+      double maxFrameTime = 0.0;
+
+      //Default to counting frames that miss 60 and 30 fps
+      int thresholdCount = 2;
+      double frameThresholds[ammonite::renderer::MAX_FRAME_THRESHOLDS] = {1.0 / 60.0, 1.0 / 30.0};
+      long thresholdFrames[ammonite::renderer::MAX_FRAME_THRESHOLDS] = {0};
+
+      long long int lastFrameTime = 0;
+    }
+
+    namespace {
+      static int getBucket(double frameTime) {
+        if (frameTime <= MIN_BUCKET_TIME) {
+          return 0;
+        }
+
+        int bucket = int(std::log(frameTime / MIN_BUCKET_TIME) / std::log(BUCKET_GROWTH));
+        return std::min(bucket, BUCKET_COUNT - 1);
+      }
+
+      //Middle of a bucket, kept within the times actually recorded
+      static double getBucketTime(int bucket) {
+        double bucketTime = MIN_BUCKET_TIME * std::pow(BUCKET_GROWTH, bucket + 0.5);
+        return std::clamp(bucketTime, minFrameTime, maxFrameTime);
+      }
+
+      //Frame time that the given fraction of frames are at or below
+      static double getPercentile(double fraction) {
+        long targetFrames = std::max(long(std::ceil(fraction * recordedFrames)), 1L);
+        long countedFrames = 0;
+        for (int i = 0; i < BUCKET_COUNT; i++) {
+          countedFrames += bucketCounts[i];
+          if (countedFrames >= targetFrames) {
+            return getBucketTime(i);
+          }
+        }
+
+        return maxFrameTime;
+      }
+
+      //Average frame rate of the slowest 1% of frames
+      static double getOnePercentLow() {
+        long targetFrames = std::max(long(std::ceil(recordedFrames * 0.01)), 1L);
+        long countedFrames = 0;
+        double countedTime = 0.0;
+        for (int i = BUCKET_COUNT - 1; i >= 0 and countedFrames < targetFrames; i--) {
+          long bucketFrames = std::min(bucketCounts[i], targetFrames - countedFrames);
+          countedFrames += bucketFrames;
+          countedTime += bucketFrames * getBucketTime(i);
+        }
+
+        return countedFrames / countedTime;
+      }
+    }
+
+    //Record the time since the last call, the first call only starts the clock
+    void recordFrame() {
+      long long int currentTime = ammonite::utils::getNanoTime();
+      if (lastFrameTime == 0) {
+        lastFrameTime = currentTime;
+        return;
+      }
+
+      double frameTime = double(currentTime - lastFrameTime) / 1000000000.0;
+      lastFrameTime = currentTime;
+
+      if (recordedFrames == 0) {
+        minFrameTime = frameTime;
+        maxFrameTime = frameTime;
+      } else {
+        minFrameTime = std::min(minFrameTime, frameTime);
+        maxFrameTime = std::max(maxFrameTime, frameTime);
+      }
+
+      bucketCounts[getBucket(frameTime)]++;
+      recordedFrames++;
+      totalTime += frameTime;
+
+      for (int i = 0; i < thresholdCount; i++) {
+        if (frameTime > frameThresholds[i]) {
+          thresholdFrames[i]++;
+        }
+      }
+    }
+
+    //Times are in seconds, the 1% low is in frames per second
+    void getFrameStats(ammonite::renderer::FrameStats* stats) {
+      *stats = ammonite::renderer::FrameStats();
+      stats->frameCount = recordedFrames;
+      stats->thresholdCount = thresholdCount;
+      for (int i = 0; i < thresholdCount; i++) {
+        stats->thresholds[i] = frameThresholds[i];
+        stats->framesOverThreshold[i] = thresholdFrames[i];
+      }
+
+      if (recordedFrames == 0) {
+        return;
+      }
+
+      stats->minTime = minFrameTime;
+      stats->meanTime = totalTime / recordedFrames;
+      stats->p50Time = getPercentile(0.50);
+      stats->p95Time = getPercentile(0.95);
+      stats->p99Time = getPercentile(0.99);
+      stats->maxTime = maxFrameTime;
+      stats->onePercentLow = getOnePercentLow();
+    }
+
+    //Forget recorded frames, the next frame is still timed from the last one
+    void resetFrameStats() {
+      std::fill(bucketCounts, bucketCounts + BUCKET_COUNT, 0);
+      std::fill(thresholdFrames, thresholdFrames + thresholdCount, 0);
+      recordedFrames = 0;
+      totalTime = 0.0;
+      minFrameTime = 0.0;
+      maxFrameTime = 0.0;
+    }
+
+    //Replace the thresholds frames are counted against, clearing their counts
+    void setThresholds(const double thresholds[], int newThresholdCount) {
+      if (newThresholdCount > ammonite::renderer::MAX_FRAME_THRESHOLDS) {
+        std::cerr << ammonite::utils::warning << "Too many frame time thresholds, using the first "
+                  << ammonite::renderer::MAX_FRAME_THRESHOLDS << std::endl;
+        newThresholdCount = ammonite::renderer::MAX_FRAME_THRESHOLDS;
+      }
+
+      thresholdCount = std::max(newThresholdCount, 0);
+      for (int i = 0; i < thresholdCount; i++) {
+        frameThresholds[i] = thresholds[i];
+        thresholdFrames[i] = 0;
+      }
+    }
+  }
+}
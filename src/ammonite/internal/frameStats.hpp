@@ -0,0 +1,21 @@
+#ifndef INTERNALFRAMESTATS
+#define INTERNALFRAMESTATS
+
+#include "../renderer.hpp"
+
+/* Internally exposed header:
+ - Allow the renderer to record the time between frames
+ - Allow the distribution of frame times to be read and reset
+*/
+
+namespace ammonite {
+  namespace frameStats {
+    void recordFrame();
+
+    void getFrameStats(ammonite::renderer::FrameStats* stats);
+    void resetFrameStats();
+    void setThresholds(const double thresholds[], int thresholdCount);
+  }
+}
+
+#endif
@@ -0,0 +1,247 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "gpuTimer.hpp"
+#include "internalSettings.hpp"
+#include "../utils/extension.hpp"
+#include "../utils/logging.hpp"
+#include "../utils/profiler.hpp"
+#include "../utils/timer.hpp"
+
+#include "internalDebug.hpp"
+
+namespace ammonite {
+  namespace gpuTiming {
+    namespace {
+      //Frames between issuing queries and reading them back, so results are ready without stalling
+      const int QUERY_FRAMES = 4;
+
+      //Weight of each new result in the rolling averages
+      const double AVERAGE_WEIGHT = 0.1;
+
+      //Timestamp queries for one frame, a begin and end for each pass and timed light
+      struct FrameQueries {
+        GLuint passQueries[PASS_COUNT * 2];
+        bool isPassIssued[PASS_COUNT];
+        std::vector<GLuint> lightQueries;
+        std::vector<bool> isLightIssued;
+        bool isIssued = false;
+      };
+
+      bool isTimingSupported = false;
+      bool* lightTimingPtr = ammonite::settings::graphics::internal::getLightTimingPtr();
+      FrameQueries frameQueries[QUERY_FRAMES];
+      int currentFrame = 0;
+
+      double passTimes[PASS_COUNT] = {0.0, 0.0, 0.0, 0.0};
+      std::vector<double> lightTimes;
+
+      //Raw totals of every frame read since the last reset, for exact means
+      double passTotals[PASS_COUNT] = {0.0, 0.0, 0.0, 0.0};
+      long readFrames = 0;
+
+#ifdef PROFILE
+      const char* passNames[PASS_COUNT] = {"Shadow pass", "Model pass", "Light emitter pass", "Skybox pass"};
+
+      //Difference between the CPU's steady clock and the GPU's clock, measured per capture
+      long long int clockOffset = 0;
+      bool isClockSynced = false;
+#endif
+    }
+
+    namespace {
+      //Fold a query pair's time into a rolling average, and return the raw time
+      static double updateAverage(double* average, GLuint beginQuery, GLuint endQuery) {
+        GLuint64 beginTime = 0, endTime = 0;
+        glGetQueryObjectui64v(beginQuery, GL_QUERY_RESULT, &beginTime);
+        glGetQueryObjectui64v(endQuery, GL_QUERY_RESULT, &endTime);
+
+        double elapsedTime = double(endTime - beginTime) / 1000000000.0;
+        if (*average == 0.0) {
+          *average = elapsedTime;
+        } else {
+          *average += (elapsedTime - *average) * AVERAGE_WEIGHT;
+        }
+
+        return elapsedTime;
+      }
+
+      //Read a frame's results into the averages, only if the last query has finished
+      static void readFrame(FrameQueries* frame) {
+        GLuint lastQuery = 0;
+        for (int i = 0; i < PASS_COUNT; i++) {
+          if (frame->isPassIssued[i]) {
+            lastQuery = frame->passQueries[(i * 2) + 1];
+          }
+        }
+
+        if (lastQuery == 0) {
+          return;
+        }
+
+        //Queries finish in order, so if the last isn't ready, skip the frame instead of waiting
+        GLint isAvailable = GL_FALSE;
+        glGetQueryObjectiv(lastQuery, GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+        if (isAvailable == GL_FALSE) {
+          return;
+        }
+
+        for (int i = 0; i < PASS_COUNT; i++) {
+          if (frame->isPassIssued[i]) {
+            passTotals[i] += updateAverage(&passTimes[i], frame->passQueries[i * 2],
+                                           frame->passQueries[(i * 2) + 1]);
+          }
+        }
+        readFrames++;
+
+#ifdef PROFILE
+        //Pass the timestamps on to a running capture, on the CPU's clock
+        if (isClockSynced) {
+          for (int i = 0; i < PASS_COUNT; i++) {
+            if (frame->isPassIssued[i]) {
+              GLuint64 beginTime = 0, endTime = 0;
+              glGetQueryObjectui64v(frame->passQueries[i * 2], GL_QUERY_RESULT, &beginTime);
+              glGetQueryObjectui64v(frame->passQueries[(i * 2) + 1], GL_QUERY_RESULT, &endTime);
+              ammonite::utils::profiler::internal::recordGpuEvent(passNames[i],
+                (long long int)beginTime + clockOffset, (long long int)endTime + clockOffset);
+            }
+          }
+        }
+#endif
+
+        for (unsigned int i = 0; i < frame->isLightIssued.size(); i++) {
+          if (frame->isLightIssued[i]) {
+            updateAverage(&lightTimes[i], frame->lightQueries[i * 2], frame->lightQueries[(i * 2) + 1]);
+          }
+        }
+      }
+    }
+
+    void setupGpuTiming() {
+      if (!ammonite::utils::checkExtension("GL_ARB_timer_query", "GL_VERSION_3_3")) {
+        std::cerr << ammonite::utils::warning << "GPU timer queries unsupported" << std::endl;
+        isTimingSupported = false;
+        return;
+      }
+
+      for (int i = 0; i < QUERY_FRAMES; i++) {
+        glCreateQueries(GL_TIMESTAMP, PASS_COUNT * 2, frameQueries[i].passQueries);
+      }
+
+      isTimingSupported = true;
+    }
+
+    //Read back the oldest frame's queries, then reuse them for the new frame
+    void beginFrame() {
+      if (!isTimingSupported) {
+        return;
+      }
+
+#ifdef PROFILE
+      //Line the GPU's clock up with the CPU's when a capture starts
+      if (ammonite::utils::profiler::isCapturing()) {
+        if (!isClockSynced) {
+          GLint64 gpuTime = 0;
+          glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+          clockOffset = ammonite::utils::getNanoTime() - gpuTime;
+          isClockSynced = true;
+        }
+      } else {
+        isClockSynced = false;
+      }
+#endif
+
+      currentFrame = (currentFrame + 1) % QUERY_FRAMES;
+      FrameQueries* frame = &frameQueries[currentFrame];
+      if (frame->isIssued) {
+        readFrame(frame);
+      }
+
+      std::fill(frame->isPassIssued, frame->isPassIssued + PASS_COUNT, false);
+      std::fill(frame->isLightIssued.begin(), frame->isLightIssued.end(), false);
+      frame->isIssued = true;
+    }
+
+    void beginPass(RenderPass pass) {
+      if (isTimingSupported) {
+        glQueryCounter(frameQueries[currentFrame].passQueries[pass * 2], GL_TIMESTAMP);
+      }
+    }
+
+    void endPass(RenderPass pass) {
+      if (isTimingSupported) {
+        FrameQueries* frame = &frameQueries[currentFrame];
+        glQueryCounter(frame->passQueries[(pass * 2) + 1], GL_TIMESTAMP);
+        frame->isPassIssued[pass] = true;
+      }
+    }
+
+    //Time a light's shadow render, if enabled, creating queries for new lights as needed
+    void beginLight(unsigned int lightIndex) {
+      if (!isTimingSupported or !*lightTimingPtr) {
+        return;
+      }
+
+      FrameQueries* frame = &frameQueries[currentFrame];
+      if (lightIndex >= frame->isLightIssued.size()) {
+        unsigned int oldSize = frame->lightQueries.size();
+        frame->lightQueries.resize((lightIndex + 1) * 2);
+        glCreateQueries(GL_TIMESTAMP, frame->lightQueries.size() - oldSize, &frame->lightQueries[oldSize]);
+        frame->isLightIssued.resize(lightIndex + 1, false);
+      }
+
+      if (lightIndex >= lightTimes.size()) {
+        lightTimes.resize(lightIndex + 1, 0.0);
+      }
+
+      glQueryCounter(frame->lightQueries[lightIndex * 2], GL_TIMESTAMP);
+    }
+
+    void endLight(unsigned int lightIndex) {
+      FrameQueries* frame = &frameQueries[currentFrame];
+      if (!isTimingSupported or !*lightTimingPtr or lightIndex >= frame->isLightIssued.size()) {
+        return;
+      }
+
+      glQueryCounter(frame->lightQueries[(lightIndex * 2) + 1], GL_TIMESTAMP);
+      frame->isLightIssued[lightIndex] = true;
+    }
+
+    //Rolling average GPU time of a pass, in seconds
+    double getPassTime(RenderPass pass) {
+      return passTimes[pass];
+    }
+
+    //Mean GPU time of each pass over the frames read since the last reset, in seconds
+    void getMeanPassTimes(double meanTimes[PASS_COUNT]) {
+      for (int i = 0; i < PASS_COUNT; i++) {
+        meanTimes[i] = (readFrames == 0) ? 0.0 : passTotals[i] / readFrames;
+      }
+    }
+
+    //Clear the averages and totals, and drop results from frames issued before the reset
+    void resetTimes() {
+      std::fill(passTimes, passTimes + PASS_COUNT, 0.0);
+      std::fill(passTotals, passTotals + PASS_COUNT, 0.0);
+      std::fill(lightTimes.begin(), lightTimes.end(), 0.0);
+      readFrames = 0;
+
+      for (int i = 0; i < QUERY_FRAMES; i++) {
+        frameQueries[i].isIssued = false;
+      }
+    }
+
+    //Fill lightTimes with each light's rolling average shadow time, returns the number written
+    int getLightTimes(double lightTimesOut[], int maxLightCount) {
+      int lightCount = std::min(int(lightTimes.size()), maxLightCount);
+      for (int i = 0; i < lightCount; i++) {
+        lightTimesOut[i] = lightTimes[i];
+      }
+
+      return lightCount;
+    }
+  }
+}
@@ -0,0 +1,34 @@
+#ifndef INTERNALGPUTIMER
+#define INTERNALGPUTIMER
+
+/* Internally exposed header:
+ - Allow the renderer to time its passes on the GPU without waiting for results
+ - Allow the averaged pass and light times to be read and reset
+*/
+
+namespace ammonite {
+  namespace gpuTiming {
+    enum RenderPass {
+      SHADOW_PASS = 0,
+      MODEL_PASS = 1,
+      EMITTER_PASS = 2,
+      SKYBOX_PASS = 3,
+      PASS_COUNT = 4
+    };
+
+    void setupGpuTiming();
+    void beginFrame();
+
+    void beginPass(RenderPass pass);
+    void endPass(RenderPass pass);
+    void beginLight(unsigned int lightIndex);
+    void endLight(unsigned int lightIndex);
+
+    double getPassTime(RenderPass pass);
+    int getLightTimes(double lightTimes[], int maxLightCount);
+    void getMeanPassTimes(double meanTimes[PASS_COUNT]);
+    void resetTimes();
+  }
+}
+
+#endif
@@ -0,0 +1,183 @@
+#include <iostream>
+#include <cstring>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/glew.h>
+
+#include "headless.hpp"
+#include "../utils/logging.hpp"
+
+#include "internalDebug.hpp"
+
+namespace ammonite {
+  namespace headless {
+    namespace {
+      EGLDisplay display = EGL_NO_DISPLAY;
+      EGLContext context = EGL_NO_CONTEXT;
+      bool isContextHeadless = false;
+
+      //Engine owned framebuffer, standing in for a window's
+      GLuint framebufferId = 0;
+      GLuint renderbufferIds[2] = {0, 0};
+      int framebufferWidth = 0;
+      int framebufferHeight = 0;
+    }
+
+    namespace {
+      static bool hasExtension(const char* extensions, const char* extension) {
+        if (extensions == nullptr) {
+          return false;
+        }
+
+        //Match whole names only, some extensions are prefixes of others
+        std::size_t length = std::strlen(extension);
+        for (const char* match = std::strstr(extensions, extension); match != nullptr;
+             match = std::strstr(match + length, extension)) {
+          bool isStart = (match == extensions) or (match[-1] == ' ');
+          if (isStart and (match[length] == ' ' or match[length] == '\0')) {
+            return true;
+          }
+        }
+
+        return false;
+      }
+
+      /*
+       - Prefer Mesa's surfaceless platform, which needs no display server or GPU
+       - Otherwise, use the default display, as long as it can run without a surface
+      */
+      static EGLDisplay getDisplay() {
+        const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless") and
+            hasExtension(clientExtensions, "EGL_EXT_platform_base")) {
+          auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+          if (getPlatformDisplay != nullptr) {
+            EGLDisplay surfacelessDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                                               EGL_DEFAULT_DISPLAY, nullptr);
+            if (surfacelessDisplay != EGL_NO_DISPLAY) {
+              return surfacelessDisplay;
+            }
+          }
+        }
+
+        return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+      }
+
+      static void deleteFramebuffer() {
+        if (framebufferId != 0) {
+          glDeleteFramebuffers(1, &framebufferId);
+          glDeleteRenderbuffers(2, renderbufferIds);
+          framebufferId = 0;
+        }
+      }
+    }
+
+    //Create and make current an OpenGL 3.2+ core context, without any surface
+    bool createContext() {
+      display = getDisplay();
+      if (display == EGL_NO_DISPLAY or !eglInitialize(display, nullptr, nullptr)) {
+        std::cerr << ammonite::utils::error << "Failed to initialise EGL display" << std::endl;
+        display = EGL_NO_DISPLAY;
+        return false;
+      }
+
+      const char* displayExtensions = eglQueryString(display, EGL_EXTENSIONS);
+      if (!hasExtension(displayExtensions, "EGL_KHR_surfaceless_context") or
+          !hasExtension(displayExtensions, "EGL_KHR_create_context") or
+          !eglBindAPI(EGL_OPENGL_API)) {
+        std::cerr << ammonite::utils::error << "EGL display doesn't support surfaceless OpenGL contexts"
+                  << std::endl;
+        destroyContext();
+        return false;
+      }
+
+      //Match the window's context, the driver may still return a newer version
+      EGLint configAttributes[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+      EGLConfig config;
+      EGLint configCount = 0;
+      if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) or configCount == 0) {
+        config = nullptr;
+      }
+
+      EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+        EGL_CONTEXT_MINOR_VERSION_KHR, 2,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+        EGL_NONE
+      };
+      context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+      if (context == EGL_NO_CONTEXT or
+          !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        std::cerr << ammonite::utils::error << "Failed to create headless OpenGL context" << std::endl;
+        destroyContext();
+        return false;
+      }
+
+      isContextHeadless = true;
+      return true;
+    }
+
+    //Create the colour and depth buffers that frames are drawn to, needs a loaded context
+    bool createFramebuffer(int width, int height) {
+      deleteFramebuffer();
+
+      glCreateRenderbuffers(2, renderbufferIds);
+      glNamedRenderbufferStorage(renderbufferIds[0], GL_SRGB8_ALPHA8, width, height);
+      glNamedRenderbufferStorage(renderbufferIds[1], GL_DEPTH24_STENCIL8, width, height);
+
+      glCreateFramebuffers(1, &framebufferId);
+      glNamedFramebufferRenderbuffer(framebufferId, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbufferIds[0]);
+      glNamedFramebufferRenderbuffer(framebufferId, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderbufferIds[1]);
+
+      if (glCheckNamedFramebufferStatus(framebufferId, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << ammonite::utils::error << "Failed to create headless framebuffer" << std::endl;
+        deleteFramebuffer();
+        return false;
+      }
+
+      framebufferWidth = width;
+      framebufferHeight = height;
+      glBindFramebuffer(GL_FRAMEBUFFER, framebufferId);
+      glViewport(0, 0, width, height);
+      return true;
+    }
+
+    void destroyContext() {
+      if (context != EGL_NO_CONTEXT) {
+        deleteFramebuffer();
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(display, context);
+        context = EGL_NO_CONTEXT;
+      }
+
+      if (display != EGL_NO_DISPLAY) {
+        eglTerminate(display);
+        display = EGL_NO_DISPLAY;
+      }
+
+      isContextHeadless = false;
+    }
+
+    bool isHeadless() {
+      return isContextHeadless;
+    }
+
+    //Framebuffer to draw frames to, 0 for a window's default framebuffer
+    GLuint getFramebufferId() {
+      return framebufferId;
+    }
+
+    //Copy the last frame as tightly packed RGBA bytes, starting from the bottom row
+    bool readPixels(unsigned char pixels[]) {
+      if (framebufferId == 0) {
+        return false;
+      }
+
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, framebufferId);
+      glPixelStorei(GL_PACK_ALIGNMENT, 1);
+      glReadPixels(0, 0, framebufferWidth, framebufferHeight, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+      return true;
+    }
+  }
+}
@@ -0,0 +1,23 @@
+#ifndef INTERNALHEADLESS
+#define INTERNALHEADLESS
+
+#include <GL/glew.h>
+
+/* Internally exposed header:
+ - Allow the window manager to create a context without a window or display
+ - Allow the renderer to draw into the engine's framebuffer instead, and read it back
+*/
+
+namespace ammonite {
+  namespace headless {
+    bool createContext();
+    bool createFramebuffer(int width, int height);
+    void destroyContext();
+
+    bool isHeadless();
+    GLuint getFramebufferId();
+    bool readPixels(unsigned char pixels[]);
+  }
+}
+
+#endif
@@ -23,6 +23,20 @@ namespace ammonite {
         int* getShadowResPtr();
         float* getShadowFarPlanePtr();
         bool* getGammaCorrectionPtr();
+        float* getLodBiasPtr();
+        int* getGpuMemoryBudgetPtr();
+        bool* getLightTimingPtr();
+      }
+    }
+
+    namespace models {
+      namespace internal {
+        bool* getCompactVerticesPtr();
+        bool* getOptimiseMeshesPtr();
+        bool* getOptimiseOverdrawPtr();
+        bool* getGenerateLodsPtr();
+        bool* getRetainMeshDataPtr();
+        bool* getPreserveHierarchyPtr();
       }
     }
 
@@ -0,0 +1,355 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include "modelTracker.hpp"
+#include "meshOptimiser.hpp"
+
+#include "internalDebug.hpp"
+
+namespace ammonite {
+  namespace models {
+    namespace optimisation {
+      namespace {
+        //Size of the simulated LRU cache used to score vertices
+        const int SCORING_CACHE_SIZE = 32;
+        //Size of the simulated FIFO cache used to measure ACMR and find clusters
+        const int ANALYSIS_CACHE_SIZE = 16;
+
+        //Vertex scoring constants, from Tom Forsyth's linear-speed optimiser
+        const float CACHE_DECAY_POWER = 1.5f;
+        const float LAST_TRIANGLE_SCORE = 0.75f;
+        const float VALENCE_BOOST_SCALE = 2.0f;
+        const float VALENCE_BOOST_POWER = 0.5f;
+
+        //Maximum ACMR increase allowed when splitting clusters for overdraw
+        const float OVERDRAW_THRESHOLD = 1.05f;
+      }
+
+      namespace {
+        static float calcVertexScore(int cachePosition, int remainingTriangles) {
+          //Vertices with nothing left to draw should never be picked
+          if (remainingTriangles == 0) {
+            return -1.0f;
+          }
+
+          float score = 0.0f;
+          if (cachePosition >= 0) {
+            if (cachePosition < 3) {
+              //Vertices used by the last triangle get a fixed score, to avoid strips
+              score = LAST_TRIANGLE_SCORE;
+            } else {
+              //Score decays towards the back of the cache
+              const float scaler = 1.0f / (SCORING_CACHE_SIZE - 3);
+              score = std::pow(1.0f - float(cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+            }
+          }
+
+          //Boost vertices with few triangles left, to clear up stragglers
+          score += VALENCE_BOOST_SCALE * std::pow(float(remainingTriangles), -VALENCE_BOOST_POWER);
+          return score;
+        }
+
+        //Simulate drawing a triangle through a FIFO cache, returning the misses
+        static int simulateTriangle(const unsigned int* triangle, std::vector<unsigned int>* cacheTimes, unsigned int* timestamp) {
+          int misses = 0;
+          for (int i = 0; i < 3; i++) {
+            unsigned int vertex = triangle[i];
+            if (*timestamp - (*cacheTimes)[vertex] > ANALYSIS_CACHE_SIZE) {
+              (*cacheTimes)[vertex] = *timestamp;
+              (*timestamp)++;
+              misses++;
+            }
+          }
+
+          return misses;
+        }
+
+        //Split triangles into clusters and draw outward facing clusters first (Tipsify)
+        static void optimiseOverdraw(std::vector<unsigned int>* indices, std::vector<VertexData>* vertices) {
+          const int triangleCount = indices->size() / 3;
+          const float meshAcmr = calcAcmr(indices, vertices->size());
+
+          //Find hard boundaries, where the cache was completely missed
+          std::vector<unsigned int> cacheTimes(vertices->size(), 0);
+          unsigned int timestamp = ANALYSIS_CACHE_SIZE + 1;
+          std::vector<int> hardBoundaries;
+          for (int i = 0; i < triangleCount; i++) {
+            if (simulateTriangle(&(*indices)[i * 3], &cacheTimes, &timestamp) == 3) {
+              hardBoundaries.push_back(i);
+            }
+          }
+          hardBoundaries.push_back(triangleCount);
+
+          //Add soft boundaries, once a cluster's ACMR is close enough to the mesh's
+          std::vector<int> clusterStarts;
+          for (unsigned int i = 0; i + 1 < hardBoundaries.size(); i++) {
+            int clusterStart = hardBoundaries[i];
+            int misses = 0;
+            timestamp += ANALYSIS_CACHE_SIZE + 1;
+            clusterStarts.push_back(clusterStart);
+
+            for (int j = hardBoundaries[i]; j < hardBoundaries[i + 1]; j++) {
+              misses += simulateTriangle(&(*indices)[j * 3], &cacheTimes, &timestamp);
+
+              float clusterAcmr = float(misses) / float(j - clusterStart + 1);
+              if (j + 1 < hardBoundaries[i + 1] and clusterAcmr <= meshAcmr * OVERDRAW_THRESHOLD) {
+                //Start a new cluster with a cold cache
+                clusterStart = j + 1;
+                misses = 0;
+                timestamp += ANALYSIS_CACHE_SIZE + 1;
+                clusterStarts.push_back(clusterStart);
+              }
+            }
+          }
+          clusterStarts.push_back(triangleCount);
+
+          //Find the centre of the mesh
+          glm::vec3 meshCentre = glm::vec3(0.0f);
+          for (unsigned int i = 0; i < vertices->size(); i++) {
+            meshCentre += (*vertices)[i].vertex;
+          }
+          meshCentre /= float(vertices->size());
+
+          //Score clusters by how far out they sit, in the direction they face
+          const int clusterCount = clusterStarts.size() - 1;
+          std::vector<float> clusterScores(clusterCount);
+          for (int i = 0; i < clusterCount; i++) {
+            glm::vec3 centroid = glm::vec3(0.0f);
+            glm::vec3 normal = glm::vec3(0.0f);
+            float totalArea = 0.0f;
+
+            for (int j = clusterStarts[i]; j < clusterStarts[i + 1]; j++) {
+              glm::vec3 a = (*vertices)[(*indices)[j * 3]].vertex;
+              glm::vec3 b = (*vertices)[(*indices)[j * 3 + 1]].vertex;
+              glm::vec3 c = (*vertices)[(*indices)[j * 3 + 2]].vertex;
+
+              //Weight by area, using the unnormalised face normal
+              glm::vec3 faceNormal = glm::cross(b - a, c - a);
+              float area = glm::length(faceNormal);
+              centroid += (a + b + c) * (area / 3.0f);
+              normal += faceNormal;
+              totalArea += area;
+            }
+
+            float normalLength = glm::length(normal);
+            if (totalArea > 0.0f and normalLength > 0.0f) {
+              centroid /= totalArea;
+              clusterScores[i] = glm::dot(centroid - meshCentre, normal / normalLength);
+            } else {
+              clusterScores[i] = 0.0f;
+            }
+          }
+
+          std::vector<int> clusterOrder(clusterCount);
+          for (int i = 0; i < clusterCount; i++) {
+            clusterOrder[i] = i;
+          }
+          std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&clusterScores](int a, int b) {
+            return clusterScores[a] > clusterScores[b];
+          });
+
+          //Write the clusters back out in sorted order
+          std::vector<unsigned int> sortedIndices;
+          sortedIndices.reserve(indices->size());
+          for (int i = 0; i < clusterCount; i++) {
+            int cluster = clusterOrder[i];
+            sortedIndices.insert(sortedIndices.end(), indices->begin() + clusterStarts[cluster] * 3,
+                                 indices->begin() + clusterStarts[cluster + 1] * 3);
+          }
+
+          *indices = sortedIndices;
+        }
+
+        //Reorder vertices by first use, dropping unreferenced vertices
+        static void optimiseVertexFetch(std::vector<unsigned int>* indices, std::vector<VertexData>* vertices) {
+          std::vector<int> remap(vertices->size(), -1);
+          int nextVertex = 0;
+          for (unsigned int i = 0; i < indices->size(); i++) {
+            unsigned int* index = &(*indices)[i];
+            if (remap[*index] == -1) {
+              remap[*index] = nextVertex++;
+            }
+            *index = remap[*index];
+          }
+
+          std::vector<VertexData> remappedVertices(nextVertex);
+          for (unsigned int i = 0; i < vertices->size(); i++) {
+            if (remap[i] != -1) {
+              remappedVertices[remap[i]] = (*vertices)[i];
+            }
+          }
+
+          *vertices = remappedVertices;
+        }
+      }
+
+      //Reorder triangles to improve post-transform cache hits (Forsyth)
+      void optimiseVertexCache(std::vector<unsigned int>* indices, int vertexCount) {
+        const int triangleCount = indices->size() / 3;
+
+        //Count the triangles using each vertex
+        std::vector<int> remainingTriangles(vertexCount, 0);
+        for (unsigned int i = 0; i < indices->size(); i++) {
+          remainingTriangles[(*indices)[i]]++;
+        }
+
+        //Build triangle adjacency for each vertex
+        std::vector<int> adjacencyOffsets(vertexCount + 1, 0);
+        for (int i = 0; i < vertexCount; i++) {
+          adjacencyOffsets[i + 1] = adjacencyOffsets[i] + remainingTriangles[i];
+        }
+
+        std::vector<int> adjacency(indices->size());
+        std::vector<int> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (unsigned int i = 0; i < indices->size(); i++) {
+          adjacency[adjacencyFill[(*indices)[i]]++] = i / 3;
+        }
+
+        //Initial vertex and triangle scores
+        std::vector<float> vertexScores(vertexCount);
+        for (int i = 0; i < vertexCount; i++) {
+          vertexScores[i] = calcVertexScore(-1, remainingTriangles[i]);
+        }
+
+        std::vector<float> triangleScores(triangleCount);
+        std::vector<bool> isEmitted(triangleCount, false);
+        int bestTriangle = 0;
+        for (int i = 0; i < triangleCount; i++) {
+          const unsigned int* triangle = &(*indices)[i * 3];
+          triangleScores[i] = vertexScores[triangle[0]] + vertexScores[triangle[1]] + vertexScores[triangle[2]];
+          if (triangleScores[i] > triangleScores[bestTriangle]) {
+            bestTriangle = i;
+          }
+        }
+
+        std::vector<unsigned int> optimisedIndices;
+        optimisedIndices.reserve(indices->size());
+
+        //LRU cache, with space for the vertices pushed out by a new triangle
+        unsigned int cache[SCORING_CACHE_SIZE + 3];
+        unsigned int newCache[SCORING_CACHE_SIZE + 3];
+        int cacheCount = 0;
+        int scanPosition = 0;
+
+        for (int emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+          //No candidate in the cache, fall back to the next unused triangle
+          if (bestTriangle < 0) {
+            while (isEmitted[scanPosition]) {
+              scanPosition++;
+            }
+            bestTriangle = scanPosition;
+          }
+
+          //Emit the triangle
+          const unsigned int* triangle = &(*indices)[bestTriangle * 3];
+          isEmitted[bestTriangle] = true;
+          for (int i = 0; i < 3; i++) {
+            unsigned int vertex = triangle[i];
+            optimisedIndices.push_back(vertex);
+
+            //Remove the triangle from the vertex's active adjacency
+            int* vertexAdjacency = &adjacency[adjacencyOffsets[vertex]];
+            int activeCount = remainingTriangles[vertex];
+            for (int j = 0; j < activeCount; j++) {
+              if (vertexAdjacency[j] == bestTriangle) {
+                std::swap(vertexAdjacency[j], vertexAdjacency[activeCount - 1]);
+                break;
+              }
+            }
+            remainingTriangles[vertex]--;
+          }
+
+          //Move the triangle's vertices to the front of the cache
+          int newCacheCount = 0;
+          for (int i = 0; i < 3; i++) {
+            newCache[newCacheCount++] = triangle[i];
+          }
+          for (int i = 0; i < cacheCount; i++) {
+            unsigned int vertex = cache[i];
+            if (vertex != triangle[0] and vertex != triangle[1] and vertex != triangle[2]) {
+              newCache[newCacheCount++] = vertex;
+            }
+          }
+
+          //Update scores of everything that moved
+          for (int i = 0; i < newCacheCount; i++) {
+            unsigned int vertex = newCache[i];
+            int cachePosition = (i < SCORING_CACHE_SIZE) ? i : -1;
+
+            float newScore = calcVertexScore(cachePosition, remainingTriangles[vertex]);
+            float scoreDelta = newScore - vertexScores[vertex];
+            vertexScores[vertex] = newScore;
+
+            const int* vertexAdjacency = &adjacency[adjacencyOffsets[vertex]];
+            for (int j = 0; j < remainingTriangles[vertex]; j++) {
+              triangleScores[vertexAdjacency[j]] += scoreDelta;
+            }
+          }
+
+          //Find the best triangle using a cached vertex
+          bestTriangle = -1;
+          float bestScore = -1.0f;
+          for (int i = 0; i < std::min(newCacheCount, SCORING_CACHE_SIZE); i++) {
+            unsigned int vertex = newCache[i];
+            const int* vertexAdjacency = &adjacency[adjacencyOffsets[vertex]];
+            for (int j = 0; j < remainingTriangles[vertex]; j++) {
+              if (triangleScores[vertexAdjacency[j]] > bestScore) {
+                bestScore = triangleScores[vertexAdjacency[j]];
+                bestTriangle = vertexAdjacency[j];
+              }
+            }
+          }
+
+          //Keep the cache, dropping anything pushed off the end
+          cacheCount = std::min(newCacheCount, SCORING_CACHE_SIZE);
+          std::copy(newCache, newCache + cacheCount, cache);
+        }
+
+        *indices = optimisedIndices;
+      }
+
+      //Average cache miss ratio, misses per triangle through a FIFO cache
+      float calcAcmr(std::vector<unsigned int>* indices, int vertexCount) {
+        const int triangleCount = indices->size() / 3;
+        if (triangleCount == 0) {
+          return 0.0f;
+        }
+
+        std::vector<unsigned int> cacheTimes(vertexCount, 0);
+        unsigned int timestamp = ANALYSIS_CACHE_SIZE + 1;
+        int misses = 0;
+        for (int i = 0; i < triangleCount; i++) {
+          misses += simulateTriangle(&(*indices)[i * 3], &cacheTimes, &timestamp);
+        }
+
+        return float(misses) / float(triangleCount);
+      }
+
+      void optimiseMesh(MeshData* meshData, bool reduceOverdraw) {
+        std::vector<unsigned int>* indices = &meshData->indices;
+        std::vector<VertexData>* vertices = &meshData->meshData;
+
+        //Only triangle lists can be optimised
+        if (indices->size() < 3 or indices->size() % 3 != 0) {
+          meshData->originalAcmr = 0.0f;
+          meshData->optimisedAcmr = 0.0f;
+          return;
+        }
+
+        meshData->originalAcmr = calcAcmr(indices, vertices->size());
+
+        optimiseVertexCache(indices, vertices->size());
+        if (reduceOverdraw) {
+          optimiseOverdraw(indices, vertices);
+        }
+        optimiseVertexFetch(indices, vertices);
+
+        meshData->optimisedAcmr = calcAcmr(indices, vertices->size());
+      }
+    }
+  }
+}
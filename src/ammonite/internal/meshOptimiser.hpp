@@ -0,0 +1,23 @@
+#ifndef INTERNALMESHOPTIMISER
+#define INTERNALMESHOPTIMISER
+
+#include <vector>
+
+#include "modelTracker.hpp"
+
+/* Internally exposed header:
+ - Allow the model loader to reorder meshes at import time
+ - Allow measuring post-transform cache efficiency
+*/
+
+namespace ammonite {
+  namespace models {
+    namespace optimisation {
+      float calcAcmr(std::vector<unsigned int>* indices, int vertexCount);
+      void optimiseVertexCache(std::vector<unsigned int>* indices, int vertexCount);
+      void optimiseMesh(MeshData* meshData, bool reduceOverdraw);
+    }
+  }
+}
+
+#endif
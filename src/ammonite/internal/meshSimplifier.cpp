@@ -0,0 +1,372 @@
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include "modelTracker.hpp"
+#include "meshOptimiser.hpp"
+#include "meshSimplifier.hpp"
+
+#include "internalDebug.hpp"
+
+namespace ammonite {
+  namespace models {
+    namespace simplification {
+      namespace {
+        //Maximum number of levels of detail to generate, after the original
+        const int MAX_LOD_LEVELS = 4;
+        //Stop generating levels once a mesh is this small
+        const unsigned int MIN_LOD_TRIANGLES = 32;
+        //Discard levels that don't remove enough triangles to be worth drawing
+        const float MIN_LOD_REDUCTION = 0.85f;
+        //Largest error allowed for any level, relative to the mesh's bounding box
+        const float MAX_LOD_ERROR = 0.1f;
+
+        //Reject collapses that rotate a face by more than ~75 degrees
+        const float MIN_FLIP_COSINE = 0.25f;
+      }
+
+      namespace {
+        //Symmetric 4x4 error quadric, weighted by triangle area
+        struct Quadric {
+          double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+          double b2 = 0.0, bc = 0.0, bd = 0.0;
+          double c2 = 0.0, cd = 0.0;
+          double d2 = 0.0;
+          double weight = 0.0;
+        };
+
+        struct Collapse {
+          unsigned int from;
+          unsigned int to;
+          double cost;
+        };
+
+        static void addQuadric(Quadric* target, const Quadric* source) {
+          target->a2 += source->a2; target->ab += source->ab;
+          target->ac += source->ac; target->ad += source->ad;
+          target->b2 += source->b2; target->bc += source->bc;
+          target->bd += source->bd; target->c2 += source->c2;
+          target->cd += source->cd; target->d2 += source->d2;
+          target->weight += source->weight;
+        }
+
+        static void addPlane(Quadric* target, glm::vec3 normal, float distance, float weight) {
+          double a = normal.x, b = normal.y, c = normal.z, d = distance;
+          Quadric plane;
+          plane.a2 = a * a * weight; plane.ab = a * b * weight;
+          plane.ac = a * c * weight; plane.ad = a * d * weight;
+          plane.b2 = b * b * weight; plane.bc = b * c * weight;
+          plane.bd = b * d * weight; plane.c2 = c * c * weight;
+          plane.cd = c * d * weight; plane.d2 = d * d * weight;
+          plane.weight = weight;
+          addQuadric(target, &plane);
+        }
+
+        //Squared distance from the planes in the quadric, averaged by area
+        static double evaluateQuadric(const Quadric* quadric, glm::vec3 point) {
+          if (quadric->weight <= 0.0) {
+            return 0.0;
+          }
+
+          double x = point.x, y = point.y, z = point.z;
+          double error = quadric->a2 * x * x + 2.0 * quadric->ab * x * y + 2.0 * quadric->ac * x * z +
+                         2.0 * quadric->ad * x + quadric->b2 * y * y + 2.0 * quadric->bc * y * z +
+                         2.0 * quadric->bd * y + quadric->c2 * z * z + 2.0 * quadric->cd * z +
+                         quadric->d2;
+          return std::fabs(error) / quadric->weight;
+        }
+
+        static std::uint64_t edgeKey(unsigned int a, unsigned int b) {
+          return (std::uint64_t(a) << 32) | b;
+        }
+
+        /*
+         - Lock vertices that can't be collapsed without tearing the mesh
+         - Borders, non-manifold edges and attribute seams are all locked
+        */
+        static void findLockedVertices(std::vector<VertexData>* vertices,
+                                       std::vector<unsigned int>* indices,
+                                       std::vector<bool>* locked) {
+          //Vertices sharing a position with another vertex sit on a seam
+          std::vector<unsigned int> sortedVertices(vertices->size());
+          for (unsigned int i = 0; i < vertices->size(); i++) {
+            sortedVertices[i] = i;
+          }
+
+          std::sort(sortedVertices.begin(), sortedVertices.end(), [vertices](unsigned int a, unsigned int b) {
+            glm::vec3 positionA = (*vertices)[a].vertex;
+            glm::vec3 positionB = (*vertices)[b].vertex;
+            if (positionA.x != positionB.x) {
+              return positionA.x < positionB.x;
+            }
+            if (positionA.y != positionB.y) {
+              return positionA.y < positionB.y;
+            }
+            return positionA.z < positionB.z;
+          });
+
+          for (unsigned int i = 1; i < sortedVertices.size(); i++) {
+            unsigned int a = sortedVertices[i - 1];
+            unsigned int b = sortedVertices[i];
+            if ((*vertices)[a].vertex == (*vertices)[b].vertex) {
+              (*locked)[a] = true;
+              (*locked)[b] = true;
+            }
+          }
+
+          //Count each directed edge, to find borders and non-manifold edges
+          std::unordered_map<std::uint64_t, int> edgeCounts;
+          edgeCounts.reserve(indices->size());
+          for (unsigned int i = 0; i < indices->size(); i += 3) {
+            for (int j = 0; j < 3; j++) {
+              unsigned int a = (*indices)[i + j];
+              unsigned int b = (*indices)[i + (j + 1) % 3];
+              edgeCounts[edgeKey(a, b)]++;
+            }
+          }
+
+          for (unsigned int i = 0; i < indices->size(); i += 3) {
+            for (int j = 0; j < 3; j++) {
+              unsigned int a = (*indices)[i + j];
+              unsigned int b = (*indices)[i + (j + 1) % 3];
+              auto twin = edgeCounts.find(edgeKey(b, a));
+              if (edgeCounts[edgeKey(a, b)] != 1 or twin == edgeCounts.end() or twin->second != 1) {
+                (*locked)[a] = true;
+                (*locked)[b] = true;
+              }
+            }
+          }
+        }
+
+        //Check moving a vertex won't flip any of its remaining triangles
+        static bool isCollapseValid(std::vector<VertexData>* vertices, std::vector<unsigned int>* indices,
+                                    std::vector<int>* adjacencyOffsets, std::vector<int>* adjacency,
+                                    unsigned int from, unsigned int to) {
+          glm::vec3 target = (*vertices)[to].vertex;
+          for (int i = (*adjacencyOffsets)[from]; i < (*adjacencyOffsets)[from + 1]; i++) {
+            const unsigned int* triangle = &(*indices)[(*adjacency)[i] * 3];
+            if (triangle[0] == to or triangle[1] == to or triangle[2] == to) {
+              //Triangle will be removed by the collapse
+              continue;
+            }
+
+            glm::vec3 corners[3];
+            for (int j = 0; j < 3; j++) {
+              corners[j] = (*vertices)[triangle[j]].vertex;
+            }
+            glm::vec3 oldNormal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+
+            for (int j = 0; j < 3; j++) {
+              if (triangle[j] == from) {
+                corners[j] = target;
+              }
+            }
+            glm::vec3 newNormal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+
+            float limit = MIN_FLIP_COSINE * glm::length(oldNormal) * glm::length(newNormal);
+            if (glm::dot(oldNormal, newNormal) <= limit) {
+              return false;
+            }
+          }
+
+          return true;
+        }
+      }
+
+      /*
+       - Simplify a triangle list by collapsing edges onto existing vertices (Garland-Heckbert)
+       - The simplified indices still refer to the original vertices, so can share buffers
+       - Returns the largest error introduced, in model space
+      */
+      float simplifyMesh(std::vector<VertexData>* vertices, std::vector<unsigned int>* indices,
+                         unsigned int targetIndexCount, float maxError,
+                         std::vector<unsigned int>* outputIndices) {
+        const int vertexCount = vertices->size();
+        std::vector<unsigned int> currentIndices = *indices;
+
+        //Sum the planes of each vertex's triangles
+        std::vector<Quadric> quadrics(vertexCount);
+        for (unsigned int i = 0; i < currentIndices.size(); i += 3) {
+          glm::vec3 a = (*vertices)[currentIndices[i]].vertex;
+          glm::vec3 b = (*vertices)[currentIndices[i + 1]].vertex;
+          glm::vec3 c = (*vertices)[currentIndices[i + 2]].vertex;
+
+          glm::vec3 normal = glm::cross(b - a, c - a);
+          float area = glm::length(normal);
+          if (area <= 0.0f) {
+            continue;
+          }
+
+          normal /= area;
+          float distance = -glm::dot(normal, a);
+          for (int j = 0; j < 3; j++) {
+            addPlane(&quadrics[currentIndices[i + j]], normal, distance, area);
+          }
+        }
+
+        std::vector<bool> locked(vertexCount, false);
+        findLockedVertices(vertices, &currentIndices, &locked);
+
+        const double maxCost = double(maxError) * double(maxError);
+        double largestCost = 0.0;
+        std::vector<Collapse> collapses;
+        std::vector<bool> isCollapsing(vertexCount);
+        std::vector<unsigned int> remap(vertexCount);
+        std::vector<int> adjacencyOffsets(vertexCount + 1);
+        std::vector<int> adjacency;
+
+        //Collapse a batch of independent edges each pass, cheapest first
+        while (currentIndices.size() > targetIndexCount) {
+          //Build triangle adjacency for the flip checks
+          std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+          for (unsigned int i = 0; i < currentIndices.size(); i++) {
+            adjacencyOffsets[currentIndices[i] + 1]++;
+          }
+          for (int i = 0; i < vertexCount; i++) {
+            adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+          }
+
+          adjacency.resize(currentIndices.size());
+          std::vector<int> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+          for (unsigned int i = 0; i < currentIndices.size(); i++) {
+            adjacency[adjacencyFill[currentIndices[i]]++] = i / 3;
+          }
+
+          //Find the cheapest direction for each edge, visiting each edge once
+          collapses.clear();
+          for (unsigned int i = 0; i < currentIndices.size(); i += 3) {
+            for (int j = 0; j < 3; j++) {
+              unsigned int a = currentIndices[i + j];
+              unsigned int b = currentIndices[i + (j + 1) % 3];
+              if (a > b or (locked[a] and locked[b])) {
+                continue;
+              }
+
+              double costA = locked[a] ? maxCost + 1.0 : evaluateQuadric(&quadrics[a], (*vertices)[b].vertex);
+              double costB = locked[b] ? maxCost + 1.0 : evaluateQuadric(&quadrics[b], (*vertices)[a].vertex);
+              if (costA <= costB) {
+                collapses.push_back({a, b, costA});
+              } else {
+                collapses.push_back({b, a, costB});
+              }
+            }
+          }
+
+          std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+            return a.cost < b.cost;
+          });
+
+          //Apply collapses that don't touch each other, until the target is met
+          std::fill(isCollapsing.begin(), isCollapsing.end(), false);
+          for (int i = 0; i < vertexCount; i++) {
+            remap[i] = i;
+          }
+
+          const unsigned int trianglesToRemove = (currentIndices.size() - targetIndexCount) / 3;
+          unsigned int removedTriangles = 0;
+          int collapseCount = 0;
+          for (unsigned int i = 0; i < collapses.size() and removedTriangles < trianglesToRemove; i++) {
+            const Collapse& collapse = collapses[i];
+            if (collapse.cost > maxCost) {
+              break;
+            }
+
+            if (isCollapsing[collapse.from] or isCollapsing[collapse.to]) {
+              continue;
+            }
+
+            if (!isCollapseValid(vertices, &currentIndices, &adjacencyOffsets, &adjacency,
+                                 collapse.from, collapse.to)) {
+              continue;
+            }
+
+            //Neighbouring collapses would invalidate the flip check
+            for (int j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1]; j++) {
+              const unsigned int* triangle = &currentIndices[adjacency[j] * 3];
+              for (int k = 0; k < 3; k++) {
+                isCollapsing[triangle[k]] = true;
+
+                //Interior edges drop the two triangles on either side
+                if (triangle[k] == collapse.to) {
+                  removedTriangles++;
+                }
+              }
+            }
+
+            remap[collapse.from] = collapse.to;
+            addQuadric(&quadrics[collapse.to], &quadrics[collapse.from]);
+            largestCost = std::max(largestCost, collapse.cost);
+            collapseCount++;
+          }
+
+          if (collapseCount == 0) {
+            break;
+          }
+
+          //Rewrite the triangles, dropping any that collapsed
+          unsigned int writeIndex = 0;
+          for (unsigned int i = 0; i < currentIndices.size(); i += 3) {
+            unsigned int a = remap[currentIndices[i]];
+            unsigned int b = remap[currentIndices[i + 1]];
+            unsigned int c = remap[currentIndices[i + 2]];
+            if (a == b or b == c or a == c) {
+              continue;
+            }
+
+            currentIndices[writeIndex++] = a;
+            currentIndices[writeIndex++] = b;
+            currentIndices[writeIndex++] = c;
+          }
+          currentIndices.resize(writeIndex);
+        }
+
+        *outputIndices = currentIndices;
+        return float(std::sqrt(largestCost));
+      }
+
+      /*
+       - Append progressively simpler index ranges to the mesh
+       - Each level targets half the triangles of the last, measured against the original
+      */
+      void generateLods(MeshData* meshData) {
+        std::vector<unsigned int> baseIndices(meshData->indices.begin(),
+                                              meshData->indices.begin() + meshData->vertexCount);
+        if (baseIndices.size() % 3 != 0) {
+          return;
+        }
+
+        const float maxError = glm::length(meshData->boundsMax - meshData->boundsMin) * MAX_LOD_ERROR;
+        unsigned int targetIndexCount = baseIndices.size();
+        unsigned int lastIndexCount = baseIndices.size();
+        float lastError = 0.0f;
+
+        std::vector<unsigned int> lodIndices;
+        for (int level = 1; level <= MAX_LOD_LEVELS; level++) {
+          targetIndexCount = (targetIndexCount / 6) * 3;
+          if (targetIndexCount / 3 < MIN_LOD_TRIANGLES) {
+            break;
+          }
+
+          float error = simplifyMesh(&meshData->meshData, &baseIndices, targetIndexCount,
+                                     maxError, &lodIndices);
+          if (float(lodIndices.size()) > float(lastIndexCount) * MIN_LOD_REDUCTION) {
+            break;
+          }
+
+          optimisation::optimiseVertexCache(&lodIndices, meshData->meshData.size());
+
+          //Errors must never shrink, or selection could pick a worse level
+          lastError = std::max(lastError, error);
+          meshData->lodLevels.push_back({int(meshData->indices.size()), int(lodIndices.size()), lastError});
+          meshData->indices.insert(meshData->indices.end(), lodIndices.begin(), lodIndices.end());
+          lastIndexCount = lodIndices.size();
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,23 @@
+#ifndef INTERNALMESHSIMPLIFIER
+#define INTERNALMESHSIMPLIFIER
+
+#include <vector>
+
+#include "modelTracker.hpp"
+
+/* Internally exposed header:
+ - Allow the model loader to generate levels of detail at import time
+*/
+
+namespace ammonite {
+  namespace models {
+    namespace simplification {
+      float simplifyMesh(std::vector<VertexData>* vertices, std::vector<unsigned int>* indices,
+                         unsigned int targetIndexCount, float maxError,
+                         std::vector<unsigned int>* outputIndices);
+      void generateLods(MeshData* meshData);
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,236 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include "modelTracker.hpp"
+#include "modelCache.hpp"
+#include "fileManager.hpp"
+#include "../utils/cacheManager.hpp"
+#include "../utils/logging.hpp"
+#include "../utils/profiler.hpp"
+
+#include "internalDebug.hpp"
+
+namespace ammonite {
+  namespace models {
+    namespace cache {
+      namespace {
+        //Increase when the layout of cached models changes
+        const unsigned int MODEL_CACHE_VERSION = 2;
+
+        struct CacheHeader {
+          unsigned int version;
+          unsigned int loadFlags;
+          unsigned int meshCount;
+        };
+
+        struct CachedMeshHeader {
+          unsigned int vertexCount;
+          unsigned int indexCount;
+          unsigned int lodCount;
+          unsigned int instanceCount;
+          unsigned int texturePathLength;
+          int drawCount;
+          glm::vec3 boundsMin;
+          glm::vec3 boundsMax;
+          float originalAcmr;
+          float optimisedAcmr;
+        };
+      }
+
+      namespace {
+        static void deleteCacheFile(std::string cacheFilePath) {
+          //Delete the cache and cacheinfo files
+          std::cout << ammonite::utils::status << "Clearing '" << cacheFilePath << "'" << std::endl;
+
+          ammonite::utils::files::deleteFile(cacheFilePath);
+          ammonite::utils::files::deleteFile(cacheFilePath + "info");
+        }
+
+        //Read a block of data, failing if the file doesn't have enough left
+        static bool readData(std::ifstream* input, void* data, std::streamsize size, std::streamsize* remaining) {
+          if (size > *remaining) {
+            return false;
+          }
+
+          input->read((char*)data, size);
+          *remaining -= size;
+          return input->good();
+        }
+      }
+
+      void cacheModel(const char* objectPath, unsigned int loadFlags, ModelData* modelData,
+                      std::vector<std::string>* texturePaths) {
+        std::string cacheFilePath = ammonite::utils::cache::requestNewCache(&objectPath, 1);
+        std::string cacheFileInfoPath = cacheFilePath + "info";
+
+        std::cout << ammonite::utils::status << "Caching '" << cacheFilePath << "'" << std::endl;
+
+        //Write the processed meshes to the cache directory
+        std::ofstream modelSave(cacheFilePath, std::ios::binary);
+        if (modelSave.is_open()) {
+          CacheHeader header = {MODEL_CACHE_VERSION, loadFlags, (unsigned int)modelData->meshes.size()};
+          modelSave.write((char*)&header, sizeof(header));
+
+          for (unsigned int i = 0; i < modelData->meshes.size(); i++) {
+            MeshData* meshData = &modelData->meshes[i];
+            std::string* texturePath = &(*texturePaths)[i];
+
+            CachedMeshHeader meshHeader;
+            meshHeader.vertexCount = meshData->meshData.size();
+            meshHeader.indexCount = meshData->indices.size();
+            meshHeader.lodCount = meshData->lodLevels.size();
+            meshHeader.instanceCount = meshData->instanceTransforms.size();
+            meshHeader.texturePathLength = texturePath->size();
+            meshHeader.drawCount = meshData->vertexCount;
+            meshHeader.boundsMin = meshData->boundsMin;
+            meshHeader.boundsMax = meshData->boundsMax;
+            meshHeader.originalAcmr = meshData->originalAcmr;
+            meshHeader.optimisedAcmr = meshData->optimisedAcmr;
+
+            modelSave.write((char*)&meshHeader, sizeof(meshHeader));
+            modelSave.write((char*)meshData->meshData.data(), meshHeader.vertexCount * sizeof(VertexData));
+            modelSave.write((char*)meshData->indices.data(), meshHeader.indexCount * sizeof(unsigned int));
+            modelSave.write((char*)meshData->lodLevels.data(), meshHeader.lodCount * sizeof(LodLevel));
+            modelSave.write((char*)meshData->instanceTransforms.data(), meshHeader.instanceCount * sizeof(glm::mat4));
+            modelSave.write(texturePath->data(), meshHeader.texturePathLength);
+          }
+
+          modelSave.close();
+        }
+
+        if (!modelSave) {
+          std::cerr << ammonite::utils::warning << "Failed to cache '" << cacheFilePath << "'" << std::endl;
+          deleteCacheFile(cacheFilePath);
+          return;
+        }
+
+        //Write the cache info to cache directory
+        std::ofstream modelInfo(cacheFileInfoPath);
+        if (modelInfo.is_open()) {
+          long long int filesize, modificationTime;
+          ammonite::utils::files::getFileMetadata(objectPath, &filesize, &modificationTime);
+
+          modelInfo << "input;" << objectPath << ";" << filesize << ";" << modificationTime << "\n";
+          modelInfo.close();
+        } else {
+          std::cerr << ammonite::utils::warning << "Failed to cache '" << cacheFileInfoPath << "'" << std::endl;
+          deleteCacheFile(cacheFilePath);
+        }
+      }
+
+      //Fill the model data from the cache, returns false if the cache can't be used
+      bool loadCachedModel(const char* objectPath, unsigned int loadFlags, ModelData* modelData,
+                           std::vector<std::string>* texturePaths) {
+        bool cacheValid = false;
+        std::string cacheFilePath = ammonite::utils::cache::requestCachedData(&objectPath, 1, &cacheValid);
+
+        //Model source doesn't match cache, delete the old cache
+        if (!cacheValid) {
+          ammoniteProfileInstant("Model cache miss");
+          if (cacheFilePath != "") {
+            deleteCacheFile(cacheFilePath);
+          }
+          return false;
+        }
+
+        std::ifstream input(cacheFilePath, std::ios::binary | std::ios::ate);
+        if (!input.is_open()) {
+          return false;
+        }
+
+        std::streamsize remaining = input.tellg();
+        input.seekg(0);
+
+        //Check the cache was created by this version, with the same settings
+        CacheHeader header;
+        bool isCacheValid = readData(&input, &header, sizeof(header), &remaining);
+        if (isCacheValid and (header.version != MODEL_CACHE_VERSION or header.loadFlags != loadFlags)) {
+          input.close();
+          deleteCacheFile(cacheFilePath);
+          ammoniteProfileInstant("Model cache miss");
+          return false;
+        }
+
+        if (isCacheValid and std::streamsize(header.meshCount * sizeof(CachedMeshHeader)) > remaining) {
+          isCacheValid = false;
+        }
+
+        if (isCacheValid) {
+          modelData->meshes.resize(header.meshCount);
+          texturePaths->resize(header.meshCount);
+        }
+
+        for (unsigned int i = 0; isCacheValid and i < header.meshCount; i++) {
+          MeshData* meshData = &modelData->meshes[i];
+          std::string* texturePath = &(*texturePaths)[i];
+
+          CachedMeshHeader meshHeader;
+          if (!readData(&input, &meshHeader, sizeof(meshHeader), &remaining)) {
+            isCacheValid = false;
+            break;
+          }
+
+          //Check the sizes before allocating, so a broken cache can't claim too much
+          std::streamsize meshSize = std::streamsize(meshHeader.vertexCount) * sizeof(VertexData) +
+                                     std::streamsize(meshHeader.indexCount) * sizeof(unsigned int) +
+                                     std::streamsize(meshHeader.lodCount) * sizeof(LodLevel) +
+                                     std::streamsize(meshHeader.instanceCount) * sizeof(glm::mat4) +
+                                     meshHeader.texturePathLength;
+          if (meshSize > remaining or meshHeader.lodCount == 0) {
+            isCacheValid = false;
+            break;
+          }
+
+          meshData->vertexCount = meshHeader.drawCount;
+          meshData->boundsMin = meshHeader.boundsMin;
+          meshData->boundsMax = meshHeader.boundsMax;
+          meshData->originalAcmr = meshHeader.originalAcmr;
+          meshData->optimisedAcmr = meshHeader.optimisedAcmr;
+
+          meshData->meshData.resize(meshHeader.vertexCount);
+          meshData->indices.resize(meshHeader.indexCount);
+          meshData->lodLevels.resize(meshHeader.lodCount);
+          meshData->instanceTransforms.resize(meshHeader.instanceCount);
+          texturePath->resize(meshHeader.texturePathLength);
+
+          isCacheValid = readData(&input, meshData->meshData.data(), meshHeader.vertexCount * sizeof(VertexData), &remaining) and
+                         readData(&input, meshData->indices.data(), meshHeader.indexCount * sizeof(unsigned int), &remaining) and
+                         readData(&input, meshData->lodLevels.data(), meshHeader.lodCount * sizeof(LodLevel), &remaining) and
+                         readData(&input, meshData->instanceTransforms.data(), meshHeader.instanceCount * sizeof(glm::mat4), &remaining) and
+                         readData(&input, texturePath->data(), meshHeader.texturePathLength, &remaining);
+
+          //Reject indices and ranges that would read outside the buffers
+          for (unsigned int j = 0; isCacheValid and j < meshHeader.indexCount; j++) {
+            isCacheValid = meshData->indices[j] < meshHeader.vertexCount;
+          }
+
+          for (unsigned int j = 0; isCacheValid and j < meshHeader.lodCount; j++) {
+            LodLevel* lodLevel = &meshData->lodLevels[j];
+            isCacheValid = lodLevel->indexOffset >= 0 and lodLevel->indexCount >= 0 and
+                           (unsigned int)(lodLevel->indexOffset + lodLevel->indexCount) <= meshHeader.indexCount;
+          }
+        }
+
+        input.close();
+
+        //Discard anything partially read, then delete the faulty cache
+        if (!isCacheValid) {
+          std::cerr << ammonite::utils::warning << "Failed to process '" << cacheFilePath << "'" << std::endl;
+          modelData->meshes.clear();
+          texturePaths->clear();
+          deleteCacheFile(cacheFilePath);
+          ammoniteProfileInstant("Model cache miss");
+          return false;
+        }
+
+        ammoniteProfileInstant("Model cache hit");
+        ammoniteInternalDebug << "Loaded cached model '" << objectPath << "'" << std::endl;
+        return true;
+      }
+    }
+  }
+}
@@ -0,0 +1,24 @@
+#ifndef INTERNALMODELCACHE
+#define INTERNALMODELCACHE
+
+#include <vector>
+#include <string>
+
+#include "modelTracker.hpp"
+
+/* Internally exposed header:
+ - Allow processed model data to be cached and reused between runs
+*/
+
+namespace ammonite {
+  namespace models {
+    namespace cache {
+      void cacheModel(const char* objectPath, unsigned int loadFlags, ModelData* modelData,
+                      std::vector<std::string>* texturePaths);
+      bool loadCachedModel(const char* objectPath, unsigned int loadFlags, ModelData* modelData,
+                           std::vector<std::string>* texturePaths);
+    }
+  }
+}
+
+#endif
@@ -19,44 +19,90 @@ namespace ammonite {
       glm::vec2 texturePoint;
     };
 
+    //Packed form of VertexData, uploaded when compact vertices are enabled
+    struct CompactVertexData {
+      glm::uint64 vertex; //3 x 16-bit unorm position, relative to the mesh bounds, then 0
+      glm::uint32 normal; //2 x 16-bit snorm, octahedral encoded
+      glm::uint32 texturePoint; //2 x 16-bit half float
+    };
+
+    //Per instance attributes, read with a divisor of 1
+    struct InstanceData {
+      glm::mat4 transform;
+      glm::mat3 normalMatrix;
+    };
+
+    //Range of the index buffer used by a level of detail
+    struct LodLevel {
+      int indexOffset;
+      int indexCount;
+      float error; //Largest deviation from the original mesh, in model space
+    };
+
     struct MeshData {
       std::vector<VertexData> meshData;
       std::vector<unsigned int> indices;
       GLuint vertexBufferId = 0; //vertexBufferId and elementBufferId must stay in this memory layout
       GLuint elementBufferId = 0;
       GLuint vertexArrayId = 0;
+      GLuint instanceBufferId = 0;
       int vertexCount = 0;
+      GLenum indexType = GL_UNSIGNED_INT;
+      bool compactVertices = false;
+      glm::vec3 boundsMin = glm::vec3(0.0f);
+      glm::vec3 boundsMax = glm::vec3(0.0f);
+      float originalAcmr = 0.0f;
+      float optimisedAcmr = 0.0f;
+      std::vector<LodLevel> lodLevels; //Full detail first, every level shares the vertices
+      std::vector<glm::mat4> instanceTransforms; //Node transforms, empty for a single untransformed copy
     };
 
     struct ModelData {
       int refCount = 1;
       int softRefCount = 0;
       std::vector<MeshData> meshes;
+      glm::vec3 boundsCentre = glm::vec3(0.0f);
+      float boundsRadius = 0.0f;
+      std::vector<float> lodErrors; //Largest error of any mesh at each level
+      bool isResident = false;
+      long lastUsedFrame = 0;
+      std::string modelName; //Path the model was loaded from
+      std::string assetKey; //Contents and options the model was loaded with
+      std::vector<GLuint> textureIds; //Texture loaded for each mesh, shared by every instance
+      unsigned int loadFlags = 0; //Settings used to process the mesh data
+      bool retainMeshData = true;
+      bool hasMeshData = true;
     };
 
+    //Matrices are only valid after updateModelMatrices()
     struct PositionData {
+      glm::vec3 position = glm::vec3(0.0f);
+      glm::quat rotation = glm::quat(glm::vec3(0.0f));
+      glm::vec3 scale = glm::vec3(1.0f);
+      bool isDirty = true;
       glm::mat4 modelMatrix;
       glm::mat3 normalMatrix;
-      glm::mat4 translationMatrix;
-      glm::mat4 scaleMatrix;
-      glm::quat rotationQuat;
     };
 
     struct ModelInfo {
       ModelData* modelData;
       PositionData positionData;
-      std::vector<GLuint> textureIds;
+      GLuint textureOverride = 0; //Texture applied to every mesh of this instance
       int drawMode = 0;
+      int lodLevel = 0;
+      int drawIndex = 0; //Index into the renderer's draw buffer, set each frame
       bool isActive = true;
       bool isLoaded = true;
       bool isLightEmitting = false;
-      std::string modelName;
       int modelId;
     };
 
     ModelInfo* getModelPtr(int modelId);
+    void getDrawableModels(const int modelIds[], int modelCount, std::vector<ModelInfo*>* modelPtrs);
     void setLightEmitting(int modelId, bool lightEmitting);
     bool getLightEmitting(int modelId);
+    void updateModelMatrices(PositionData* positionData);
+    void markModelUsed(ModelInfo* modelPtr);
   }
 }
 
@@ -0,0 +1,56 @@
+#include <GL/glew.h>
+
+#include "renderStats.hpp"
+
+#include "internalDebug.hpp"
+
+namespace ammonite {
+  namespace renderStats {
+    namespace {
+      //Counts for the frame being built, and the last complete frame
+      ammonite::renderer::RenderStats currentStats;
+      ammonite::renderer::RenderStats lastStats;
+    }
+
+    /*
+     - Triangles are counted after any geometry shader amplification
+     - Points and lines don't produce triangles, but are still counted as draws and indices
+    */
+    void countDraw(GLenum mode, int indexCount, int instanceCount, int amplification) {
+      long long int drawnIndices = (long long int)indexCount * instanceCount;
+      currentStats.drawCalls++;
+      currentStats.indexCount += drawnIndices;
+      if (mode == GL_TRIANGLES) {
+        currentStats.triangleCount += (drawnIndices / 3) * amplification;
+      }
+    }
+
+    void countProgramSwitch() {
+      currentStats.programSwitches++;
+    }
+
+    void countTextureBind() {
+      currentStats.textureBinds++;
+    }
+
+    void countBufferUpload(long long int bytes) {
+      currentStats.bufferUploads++;
+      currentStats.uploadedBytes += bytes;
+    }
+
+    void countTextureUpload(long long int bytes) {
+      currentStats.textureUploads++;
+      currentStats.uploadedBytes += bytes;
+    }
+
+    //Keep the finished frame's counts, anything submitted between frames joins the next one
+    void endFrame() {
+      lastStats = currentStats;
+      currentStats = ammonite::renderer::RenderStats();
+    }
+
+    void getRenderStats(ammonite::renderer::RenderStats* stats) {
+      *stats = lastStats;
+    }
+  }
+}
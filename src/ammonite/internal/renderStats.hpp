@@ -0,0 +1,26 @@
+#ifndef INTERNALRENDERSTATS
+#define INTERNALRENDERSTATS
+
+#include <GL/glew.h>
+
+#include "../renderer.hpp"
+
+/* Internally exposed header:
+ - Allow the renderer, model, light and texture code to count the work they submit
+ - Allow the counts from the last complete frame to be read
+*/
+
+namespace ammonite {
+  namespace renderStats {
+    void countDraw(GLenum mode, int indexCount, int instanceCount, int amplification);
+    void countProgramSwitch();
+    void countTextureBind();
+    void countBufferUpload(long long int bytes);
+    void countTextureUpload(long long int bytes);
+
+    void endFrame();
+    void getRenderStats(ammonite::renderer::RenderStats* stats);
+  }
+}
+
+#endif
@@ -0,0 +1,88 @@
+#include <iostream>
+#include <map>
+#include <vector>
+#include <algorithm>
+
+#include "internalSettings.hpp"
+#include "residency.hpp"
+
+#include "internalDebug.hpp"
+
+namespace ammonite {
+  namespace residency {
+    namespace {
+      struct ResidentResource {
+        long long bytes;
+        long* lastUsedFrame;
+        void (*evictResource)(void*);
+      };
+
+      std::map<void*, ResidentResource> residentResources;
+      long long residentBytes = 0;
+      long currentFrame = 0;
+    }
+
+    //Track a resource uploaded to the GPU, new resources count as used this frame
+    void addResource(void* resource, long long bytes, long* lastUsedFrame, void (*evictResource)(void*)) {
+      removeResource(resource);
+
+      *lastUsedFrame = currentFrame;
+      residentResources[resource] = {bytes, lastUsedFrame, evictResource};
+      residentBytes += bytes;
+    }
+
+    void removeResource(void* resource) {
+      auto it = residentResources.find(resource);
+      if (it != residentResources.end()) {
+        residentBytes -= it->second.bytes;
+        residentResources.erase(it);
+      }
+    }
+
+    long getCurrentFrame() {
+      return currentFrame;
+    }
+
+    long long getResidentBytes() {
+      return residentBytes;
+    }
+
+    /*
+     - Evict least recently used resources until the budget is met
+     - Resources drawn in the last frame are never evicted, to avoid thrashing
+    */
+    void enforceBudget(long frame) {
+      currentFrame = frame;
+
+      static int* budgetPtr = ammonite::settings::graphics::internal::getGpuMemoryBudgetPtr();
+      const long long budgetBytes = (long long)(*budgetPtr) * 1024 * 1024;
+      if (*budgetPtr <= 0 or residentBytes <= budgetBytes) {
+        return;
+      }
+
+      //Sort candidates by the frame they were last drawn in
+      std::vector<std::pair<long, void*>> candidates;
+      for (auto it = residentResources.begin(); it != residentResources.end(); it++) {
+        long lastUsedFrame = *it->second.lastUsedFrame;
+        if (lastUsedFrame < currentFrame - 1) {
+          candidates.push_back({lastUsedFrame, it->first});
+        }
+      }
+      std::sort(candidates.begin(), candidates.end());
+
+      unsigned int evictedCount = 0;
+      for (; evictedCount < candidates.size() and residentBytes > budgetBytes; evictedCount++) {
+        void* resource = candidates[evictedCount].second;
+        void (*evictResource)(void*) = residentResources[resource].evictResource;
+
+        //Stop tracking first, the callback may release the resource's memory
+        removeResource(resource);
+        evictResource(resource);
+      }
+
+      if (evictedCount != 0) {
+        ammoniteInternalDebug << "Evicted " << evictedCount << " GPU resources, " << residentBytes << " bytes resident" << std::endl;
+      }
+    }
+  }
+}
@@ -0,0 +1,20 @@
+#ifndef INTERNALRESIDENCY
+#define INTERNALRESIDENCY
+
+/* Internally exposed header:
+ - Allow GPU resources to be tracked against the memory budget
+ - Allow the renderer to evict least recently used resources
+*/
+
+namespace ammonite {
+  namespace residency {
+    void addResource(void* resource, long long bytes, long* lastUsedFrame, void (*evictResource)(void*));
+    void removeResource(void* resource);
+
+    long getCurrentFrame();
+    long long getResidentBytes();
+    void enforceBudget(long currentFrame);
+  }
+}
+
+#endif
@@ -3,11 +3,13 @@
 
 /* Internally exposed header:
  - Allow window manager to prompt checking for cache support
+ - Allow window manager to enable parallel shader compiling
 */
 
 namespace ammonite {
   namespace shaders {
     void updateGLCacheSupport();
+    void updateParallelCompileSupport();
   }
 }
 
@@ -1,28 +1,405 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <vector>
+#include <algorithm>
 #include <cmath>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 #include <GL/glew.h>
 
+#include "textures.hpp"
+#include "residency.hpp"
+#include "assetRegistry.hpp"
+#include "renderStats.hpp"
 #include "../utils/logging.hpp"
+#include "../utils/profiler.hpp"
 
 #include "internalDebug.hpp"
 
 namespace ammonite {
   namespace {
+    //Texture IDs are material indices, 0 is reserved for untextured meshes
     struct TextureInfo {
       GLuint textureId;
       int refCount = 1;
+      int poolIndex;
+      int layer;
+      bool srgbTexture;
+      std::string texturePath; //Path it was first loaded from, used to reload it
+      bool isResident = true;
+      long lastUsedFrame = 0;
     };
 
+    /*
+     - Array texture holding loaded textures of one size bucket and colour space
+     - Textures are stretched to the next power of two up, or to the closest pool once every
+       pool is in use, so loading never fails for lack of a pool
+    */
+    struct TexturePool {
+      GLuint textureId = 0;
+      GLenum internalFormat;
+      int width;
+      int height;
+      int mipmapLevels;
+      int layerCount = 0;
+      int layerCapacity = 0;
+      std::vector<int> freeLayers;
+    };
+
+    //Material pool for evicted textures, sampled as untextured
+    const GLuint NO_TEXTURE_POOL = 0xFFFFFFFF;
+
+    //Matches the std430 layout of materials in the model shader
+    struct MaterialData {
+      GLuint pool;
+      GLuint layer;
+    };
+
+    //Textures are tracked by a key of their contents and format
     std::map<std::string, TextureInfo> textureTrackerMap;
     std::map<GLuint, std::string> textureIdNameMap;
+
+    std::vector<TexturePool> texturePools;
+    std::vector<MaterialData> materials(1, {NO_TEXTURE_POOL, 0});
+    std::vector<TextureInfo*> materialTextures(1, nullptr);
+    std::vector<GLuint> freeMaterials;
+    GLuint materialBufferId = 0;
+    unsigned int materialBufferCapacity = 0;
+  }
+
+  namespace {
+    //Every texture is stored with an alpha channel, so colour space is the only format split
+    static GLenum getPoolFormat(bool srgbTexture) {
+      return srgbTexture ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    }
+
+    static int getTexelBytes(GLenum internalFormat) {
+      if (internalFormat == GL_RGB8 or internalFormat == GL_SRGB8) {
+        return 3;
+      }
+
+      return 4;
+    }
+
+    //Round a texture dimension up to its size bucket
+    static int getBucketSize(int size) {
+      static GLint maxTextureSize = 0;
+      if (maxTextureSize == 0) {
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+      }
+
+      int bucketSize = 1;
+      while (bucketSize < size and bucketSize < maxTextureSize) {
+        bucketSize *= 2;
+      }
+
+      return bucketSize;
+    }
+
+    /*
+     - Find the pool for a size bucket and format, creating it if there's space
+     - The last free slot is kept for the other colour space, if it has no pool yet
+     - Once every slot is in use, fall back to the closest sized pool of the same format
+    */
+    static int findTexturePool(GLenum internalFormat, int width, int height) {
+      int emptyPool = -1;
+      int usedPools = 0;
+      int sameFormatPools = 0;
+      int closestPool = -1;
+      float closestDistance = 0.0f;
+      for (unsigned int i = 0; i < texturePools.size(); i++) {
+        TexturePool* pool = &texturePools[i];
+        if (pool->textureId == 0) {
+          emptyPool = (emptyPool == -1) ? i : emptyPool;
+          continue;
+        }
+
+        usedPools++;
+        if (pool->internalFormat != internalFormat) {
+          continue;
+        }
+
+        if (pool->width == width and pool->height == height) {
+          return i;
+        }
+
+        sameFormatPools++;
+        float distance = std::abs(std::log2(float(pool->width) / float(width))) +
+                         std::abs(std::log2(float(pool->height) / float(height)));
+        if (closestPool == -1 or distance < closestDistance) {
+          closestPool = i;
+          closestDistance = distance;
+        }
+      }
+
+      int otherFormatPools = usedPools - sameFormatPools;
+      int freePools = textures::MAX_TEXTURE_POOLS - usedPools;
+      bool canCreatePool = (freePools > 1) or
+        (freePools == 1 and (sameFormatPools == 0 or otherFormatPools > 0));
+      if (!canCreatePool) {
+        return closestPool;
+      }
+
+      //Reuse a released pool slot, or add a new one
+      if (emptyPool == -1) {
+        emptyPool = texturePools.size();
+        texturePools.emplace_back();
+      }
+
+      TexturePool* pool = &texturePools[emptyPool];
+      *pool = TexturePool();
+      pool->internalFormat = internalFormat;
+      pool->width = width;
+      pool->height = height;
+      pool->mipmapLevels = std::floor(std::log2(std::max(width, height))) + 1;
+      return emptyPool;
+    }
+
+    //Stretch an image over the first level of a texture, filtering linearly
+    static void stretchImage(GLuint targetTextureId, int targetWidth, int targetHeight, GLenum internalFormat,
+                             int width, int height, GLenum dataFormat, unsigned char* data) {
+      GLuint sourceTextureId;
+      glCreateTextures(GL_TEXTURE_2D, 1, &sourceTextureId);
+      glTextureStorage2D(sourceTextureId, 1, internalFormat, width, height);
+      glTextureSubImage2D(sourceTextureId, 0, 0, 0, width, height, dataFormat, GL_UNSIGNED_BYTE, data);
+
+      GLuint framebufferIds[2];
+      glCreateFramebuffers(2, framebufferIds);
+      glNamedFramebufferTexture(framebufferIds[0], GL_COLOR_ATTACHMENT0, sourceTextureId, 0);
+      glNamedFramebufferTexture(framebufferIds[1], GL_COLOR_ATTACHMENT0, targetTextureId, 0);
+      glNamedFramebufferReadBuffer(framebufferIds[0], GL_COLOR_ATTACHMENT0);
+      glNamedFramebufferDrawBuffer(framebufferIds[1], GL_COLOR_ATTACHMENT0);
+
+      //Copy the texels as stored, without any colour space conversion
+      bool isSrgbEnabled = glIsEnabled(GL_FRAMEBUFFER_SRGB);
+      glDisable(GL_FRAMEBUFFER_SRGB);
+      glBlitNamedFramebuffer(framebufferIds[0], framebufferIds[1], 0, 0, width, height,
+                             0, 0, targetWidth, targetHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+      if (isSrgbEnabled) {
+        glEnable(GL_FRAMEBUFFER_SRGB);
+      }
+
+      glDeleteFramebuffers(2, framebufferIds);
+      glDeleteTextures(1, &sourceTextureId);
+    }
+
+    //Update a material in the table and upload it, growing the buffer if needed
+    static void setMaterial(GLuint materialIndex, GLuint poolIndex, GLuint layer) {
+      materials[materialIndex] = {poolIndex, layer};
+
+      if (materials.size() > materialBufferCapacity) {
+        if (materialBufferId != 0) {
+          glDeleteBuffers(1, &materialBufferId);
+        }
+
+        //Recreate the buffer with spare space, and upload every material
+        materialBufferCapacity = std::max((unsigned int)materials.size(), materialBufferCapacity * 2);
+        glCreateBuffers(1, &materialBufferId);
+        glNamedBufferData(materialBufferId, materialBufferCapacity * sizeof(MaterialData), nullptr, GL_DYNAMIC_DRAW);
+        glNamedBufferSubData(materialBufferId, 0, materials.size() * sizeof(MaterialData), &materials[0]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, materialBufferId);
+        ammonite::renderStats::countBufferUpload(materials.size() * sizeof(MaterialData));
+      } else {
+        glNamedBufferSubData(materialBufferId, materialIndex * sizeof(MaterialData), sizeof(MaterialData), &materials[materialIndex]);
+        ammonite::renderStats::countBufferUpload(sizeof(MaterialData));
+      }
+    }
+
+    //Create array storage for a pool, with room for the given number of layers
+    static GLuint createPoolStorage(TexturePool* pool, int layerCapacity) {
+      GLuint textureId;
+      glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &textureId);
+      glTextureStorage3D(textureId, pool->mipmapLevels, pool->internalFormat, pool->width, pool->height, layerCapacity);
+
+      //When magnifying the image, use linear filtering
+      glTextureParameteri(textureId, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      //When minifying the image, use a linear blend of two mipmaps
+      glTextureParameteri(textureId, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+      return textureId;
+    }
+
+    //Copy every mipmap of a run of layers between two storages of a pool
+    static void copyLayers(TexturePool* pool, GLuint sourceId, int sourceLayer,
+                           GLuint targetId, int targetLayer, int layerCount) {
+      for (int level = 0; level < pool->mipmapLevels; level++) {
+        int levelWidth = std::max(pool->width >> level, 1);
+        int levelHeight = std::max(pool->height >> level, 1);
+        glCopyImageSubData(sourceId, GL_TEXTURE_2D_ARRAY, level, 0, 0, sourceLayer,
+                           targetId, GL_TEXTURE_2D_ARRAY, level, 0, 0, targetLayer,
+                           levelWidth, levelHeight, layerCount);
+      }
+    }
+
+    //Return a free layer of the pool, doubling its storage when full
+    static int reserveLayer(TexturePool* pool) {
+      if (!pool->freeLayers.empty()) {
+        int layer = pool->freeLayers.back();
+        pool->freeLayers.pop_back();
+        return layer;
+      }
+
+      if (pool->layerCount == pool->layerCapacity) {
+        int newCapacity = std::max(pool->layerCapacity * 2, 1);
+        GLuint newTextureId = createPoolStorage(pool, newCapacity);
+
+        //Copy existing layers across, then replace the old storage
+        if (pool->textureId != 0) {
+          copyLayers(pool, pool->textureId, 0, newTextureId, 0, pool->layerCount);
+          glDeleteTextures(1, &pool->textureId);
+        }
+
+        pool->textureId = newTextureId;
+        pool->layerCapacity = newCapacity;
+      }
+
+      return pool->layerCount++;
+    }
+
+    /*
+     - Move a pool's resident textures into the smallest power of two storage that holds them
+     - Pools shrink like this once under half full, so releasing layers frees memory
+     - Released textures must already be non-resident or untracked, so they aren't copied
+    */
+    static void compactPool(int poolIndex, int usedLayers) {
+      TexturePool* pool = &texturePools[poolIndex];
+      int newCapacity = 1;
+      while (newCapacity < usedLayers) {
+        newCapacity *= 2;
+      }
+
+      //Pack the layers, and point their materials at the new storage
+      GLuint newTextureId = createPoolStorage(pool, newCapacity);
+      int nextLayer = 0;
+      for (unsigned int i = 0; i < materialTextures.size(); i++) {
+        TextureInfo* textureInfo = materialTextures[i];
+        if (textureInfo == nullptr or !textureInfo->isResident or textureInfo->poolIndex != poolIndex) {
+          continue;
+        }
+
+        copyLayers(pool, pool->textureId, textureInfo->layer, newTextureId, nextLayer, 1);
+        textureInfo->layer = nextLayer++;
+        setMaterial(textureInfo->textureId, poolIndex, textureInfo->layer);
+      }
+
+      glDeleteTextures(1, &pool->textureId);
+      pool->textureId = newTextureId;
+      pool->layerCapacity = newCapacity;
+      pool->layerCount = nextLayer;
+      pool->freeLayers.clear();
+    }
+
+    static void releaseLayer(int poolIndex, int layer) {
+      TexturePool* pool = &texturePools[poolIndex];
+      pool->freeLayers.push_back(layer);
+
+      //Delete the pool's storage once nothing uses it, or shrink it once under half full
+      int usedLayers = pool->layerCount - int(pool->freeLayers.size());
+      if (usedLayers == 0) {
+        glDeleteTextures(1, &pool->textureId);
+        *pool = TexturePool();
+      } else if (usedLayers < pool->layerCapacity / 2) {
+        compactPool(poolIndex, usedLayers);
+      }
+    }
+
+    static GLuint createMaterial(int poolIndex, int layer) {
+      GLuint materialIndex;
+      if (!freeMaterials.empty()) {
+        materialIndex = freeMaterials.back();
+        freeMaterials.pop_back();
+      } else {
+        materialIndex = materials.size();
+        materials.emplace_back();
+        materialTextures.push_back(nullptr);
+      }
+
+      setMaterial(materialIndex, poolIndex, layer);
+      return materialIndex;
+    }
+
+    //Read a texture from disk into a free layer of a pool, returns false on failure
+    static bool uploadTexture(const char* texturePath, bool srgbTexture, int* poolIndex,
+                              int* layer, long long* textureBytes) {
+      ammoniteProfileZone("uploadTexture");
+      //Read image data
+      int width, height, nChannels;
+      unsigned char* data = stbi_load(texturePath, &width, &height, &nChannels, 0);
+
+      if (!data) {
+        std::cerr << ammonite::utils::warning << "Failed to load texture '" << texturePath << "'" << std::endl;
+        return false;
+      }
+
+      //Decide the format of the data, the texture is stored in the pool's format
+      GLenum internalFormat;
+      GLenum dataFormat;
+      if (!textures::getTextureFormat(nChannels, srgbTexture, &internalFormat, &dataFormat)) {
+        std::cerr << ammonite::utils::warning << "Failed to load texture '" << texturePath << "'" << std::endl;
+        stbi_image_free(data);
+        return false;
+      }
+
+      //Find an array texture for this size bucket and format
+      internalFormat = getPoolFormat(srgbTexture);
+      *poolIndex = findTexturePool(internalFormat, getBucketSize(width), getBucketSize(height));
+      TexturePool* pool = &texturePools[*poolIndex];
+      if (pool->width != width or pool->height != height) {
+        ammoniteInternalDebug << "Stretching texture '" << texturePath << "' from " << width << "x" << height
+                              << " to " << pool->width << "x" << pool->height << std::endl;
+      }
+
+      //Create and fill a temporary texture at the pool's size, to generate mipmaps for this layer only
+      GLuint uploadTextureId;
+      glCreateTextures(GL_TEXTURE_2D, 1, &uploadTextureId);
+      glTextureStorage2D(uploadTextureId, pool->mipmapLevels, internalFormat, pool->width, pool->height);
+      if (pool->width == width and pool->height == height) {
+        glTextureSubImage2D(uploadTextureId, 0, 0, 0, width, height, dataFormat, GL_UNSIGNED_BYTE, data);
+      } else {
+        stretchImage(uploadTextureId, pool->width, pool->height, internalFormat, width, height, dataFormat, data);
+      }
+      ammonite::renderStats::countTextureUpload((long long)width * height * nChannels);
+      glGenerateTextureMipmap(uploadTextureId);
+
+      //Release the image data
+      stbi_image_free(data);
+
+      //Copy every mipmap into a layer of the pool, counting the memory used
+      *layer = reserveLayer(pool);
+      *textureBytes = 0;
+      for (int level = 0; level < pool->mipmapLevels; level++) {
+        int levelWidth = std::max(pool->width >> level, 1);
+        int levelHeight = std::max(pool->height >> level, 1);
+        glCopyImageSubData(uploadTextureId, GL_TEXTURE_2D, level, 0, 0, 0,
+                           pool->textureId, GL_TEXTURE_2D_ARRAY, level, 0, 0, *layer,
+                           levelWidth, levelHeight, 1);
+        *textureBytes += (long long)levelWidth * levelHeight * getTexelBytes(pool->internalFormat);
+      }
+      glDeleteTextures(1, &uploadTextureId);
+
+      return true;
+    }
+
+    //Free the texture's layer, but keep its material so it can be restored when drawn
+    static void evictTexture(void* resource) {
+      TextureInfo* textureInfo = (TextureInfo*)resource;
+      textureInfo->isResident = false;
+      setMaterial(textureInfo->textureId, NO_TEXTURE_POOL, 0);
+      releaseLayer(textureInfo->poolIndex, textureInfo->layer);
+    }
   }
 
   namespace textures {
+    //Bind every texture pool, starting from the given texture unit
+    void bindTexturePools(GLuint firstUnit) {
+      for (unsigned int i = 0; i < texturePools.size(); i++) {
+        glBindTextureUnit(firstUnit + i, texturePools[i].textureId);
+        ammonite::renderStats::countTextureBind();
+      }
+    }
+
     void deleteTexture(GLuint textureId) {
       //Check the texture has been loaded, and get a textureName
       std::string textureName;
@@ -37,9 +414,16 @@ namespace ammonite {
       //Decrease the reference counter
       textureInfo->refCount--;
 
-      //If texture is now unused, delete the buffer and tracker elements
+      //If texture is now unused, free its layer, material and tracker elements
       if (textureInfo->refCount < 1) {
-        glDeleteTextures(1, &textureId);
+        setMaterial(textureId, NO_TEXTURE_POOL, 0);
+        materialTextures[textureId] = nullptr;
+        if (textureInfo->isResident) {
+          ammonite::residency::removeResource(textureInfo);
+          releaseLayer(textureInfo->poolIndex, textureInfo->layer);
+        }
+
+        freeMaterials.push_back(textureId);
         textureTrackerMap.erase(textureName);
         textureIdNameMap.erase(textureId);
       }
@@ -67,63 +451,70 @@ namespace ammonite {
     }
 
     GLuint loadTexture(const char* texturePath, bool srgbTexture, bool* externalSuccess) {
-      //Check if texture has already been loaded
-      std::string textureString = std::string(texturePath);
-      if (textureTrackerMap.find(textureString) != textureTrackerMap.end()) {
-        TextureInfo* textureInfo = &textureTrackerMap[texturePath];
-
-        textureInfo->refCount++;
-        return textureInfo->textureId;
-      }
-
-      //Read image data
-      int width, height, nChannels;
-      unsigned char* data = stbi_load(texturePath, &width, &height, &nChannels, 0);
-
-      if (!data) {
-        std::cerr << ammonite::utils::warning << "Failed to load texture '" << texturePath << "'" << std::endl;
-        *externalSuccess = false;
-        return 0;
+      //Check if texture has already been loaded, from any path
+      std::string textureString = ammonite::registry::getAssetKey(texturePath, srgbTexture, false);
+      auto it = textureTrackerMap.find(textureString);
+      ammonite::registry::recordRequest(ammonite::registry::TEXTURE_ASSET, it != textureTrackerMap.end());
+      if (it != textureTrackerMap.end()) {
+        it->second.refCount++;
+        return it->second.textureId;
       }
 
-      //Create a texture
-      GLuint textureId;
-      glCreateTextures(GL_TEXTURE_2D, 1, &textureId);
-
-      //Decide the format of the texture and data
-      GLenum internalFormat;
-      GLenum dataFormat;
-      if (!getTextureFormat(nChannels, srgbTexture, &internalFormat, &dataFormat)) {
-        std::cerr << ammonite::utils::warning << "Failed to load texture '" << texturePath << "'" << std::endl;
-        glDeleteTextures(1, &textureId);
+      int poolIndex, layer;
+      long long textureBytes;
+      if (!uploadTexture(texturePath, srgbTexture, &poolIndex, &layer, &textureBytes)) {
         *externalSuccess = false;
         return 0;
       }
 
-      //Create and fill immutable storage for the texture
-      int mipmapLevels = std::floor(std::log2(std::max(width, height))) + 1;
-      glTextureStorage2D(textureId, mipmapLevels, internalFormat, width, height);
-      glTextureSubImage2D(textureId, 0, 0, 0, width, height, dataFormat, GL_UNSIGNED_BYTE, data);
-
-      //When magnifying the image, use linear filtering
-      glTextureParameteri(textureId, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-      //When minifying the image, use a linear blend of two mipmaps
-      glTextureParameteri(textureId, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-      //Generate mipmaps
-      glGenerateTextureMipmap(textureId);
-
-      //Release the image data
-      stbi_image_free(data);
-
       //Save texture's info to textureTracker
+      GLuint textureId = createMaterial(poolIndex, layer);
       TextureInfo currentTexture;
       currentTexture.textureId = textureId;
+      currentTexture.poolIndex = poolIndex;
+      currentTexture.layer = layer;
+      currentTexture.srgbTexture = srgbTexture;
+      currentTexture.texturePath = std::string(texturePath);
       textureTrackerMap[textureString] = currentTexture;
 
+      //Track the layer against the memory budget
+      TextureInfo* textureInfo = &textureTrackerMap[textureString];
+      materialTextures[textureId] = textureInfo;
+      ammonite::residency::addResource(textureInfo, textureBytes, &textureInfo->lastUsedFrame, evictTexture);
+
       textureIdNameMap[textureId] = textureString;
       return textureId;
     }
 
+    //Mark a texture as drawn this frame, reloading it if it was evicted
+    void markTextureUsed(GLuint textureId) {
+      if (textureId >= materialTextures.size() or materialTextures[textureId] == nullptr) {
+        return;
+      }
+
+      TextureInfo* textureInfo = materialTextures[textureId];
+      textureInfo->lastUsedFrame = ammonite::residency::getCurrentFrame();
+      if (textureInfo->isResident) {
+        return;
+      }
+
+      //Reload the texture from its source file
+      int poolIndex, layer;
+      long long textureBytes;
+      const char* texturePath = textureInfo->texturePath.c_str();
+      if (!uploadTexture(texturePath, textureInfo->srgbTexture, &poolIndex, &layer, &textureBytes)) {
+        //Leave the material untextured, and stop retrying every frame
+        materialTextures[textureId] = nullptr;
+        return;
+      }
+
+      textureInfo->poolIndex = poolIndex;
+      textureInfo->layer = layer;
+      textureInfo->isResident = true;
+      setMaterial(textureId, poolIndex, layer);
+      ammonite::residency::addResource(textureInfo, textureBytes, &textureInfo->lastUsedFrame, evictTexture);
+    }
+
     void copyTexture(GLuint textureId) {
       //Increase reference count on given texture, if it exists
       if (textureIdNameMap.find(textureId) != textureIdNameMap.end()) {
@@ -5,10 +5,15 @@
 
 namespace ammonite {
   namespace textures {
+    //Must match MAX_TEXTURE_POOLS in the model shader
+    const int MAX_TEXTURE_POOLS = 12;
+
     bool getTextureFormat(int nChannels, bool srgbTexture, GLenum* internalFormat, GLenum* dataFormat);
     GLuint loadTexture(const char* texturePath, bool srgbTexture, bool* externalSuccess);
     void deleteTexture(GLuint textureId);
     void copyTexture(GLuint textureId);
+    void markTextureUsed(GLuint textureId);
+    void bindTexturePools(GLuint firstUnit);
   }
 }
 
@@ -1,6 +1,5 @@
 #include <map>
 #include <vector>
-#include <cstring>
 #include <cmath>
 
 #include <GL/glew.h>
@@ -12,7 +11,9 @@
 #include "internal/internalSettings.hpp"
 #include "internal/lightTracker.hpp"
 #include "internal/modelTracker.hpp"
+#include "internal/renderStats.hpp"
 #include "modelManager.hpp"
+#include "utils/profiler.hpp"
 
 #include "internal/internalDebug.hpp"
 
@@ -20,13 +21,13 @@ namespace ammonite {
   namespace {
     //Lighting shader storage buffer IDs
     GLuint lightDataId = 0;
+    GLuint lightTransformsId = 0;
 
     //Default ambient light
     glm::vec3 ambientLight = glm::vec3(0.0f, 0.0f, 0.0f);
 
     //Track light sources
     std::map<int, lighting::LightSource> lightTrackerMap;
-    std::map<int, glm::mat4[6]> lightTransformMap;
     unsigned int prevLightCount = 0;
 
     //Track cumulative number of created light sources
@@ -62,10 +63,6 @@ namespace ammonite {
       return &lightTrackerMap;
     }
 
-    std::map<int, glm::mat4[6]>* getLightTransforms() {
-      return &lightTransformMap;
-    }
-
     //Unlink a light source from a model, using only the model ID (doesn't touch the model)
     void unlinkByModel(int modelId) {
       //Check if the model has already been linked to
@@ -88,6 +85,7 @@ namespace ammonite {
   //Exposed light handling methods
   namespace lighting {
     void updateLightSources() {
+      ammoniteProfileZone("updateLightSources");
       //Data structure to pass light sources into shader
       struct ShaderLightSource {
         glm::vec4 geometry;
@@ -110,17 +108,20 @@ namespace ammonite {
       //If no lights remain, unbind and return early
       if (lightTrackerMap.size() == 0) {
         glDeleteBuffers(1, &lightDataId);
+        glDeleteBuffers(1, &lightTransformsId);
         glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, 0);
         lightDataId = 0;
+        lightTransformsId = 0;
+        prevLightCount = 0;
         return;
       }
 
       static float* farPlanePtr = ammonite::settings::graphics::internal::getShadowFarPlanePtr();
       glm::mat4 shadowProj = glm::perspective(glm::radians(90.0f), 1.0f, 0.0f, *farPlanePtr);
 
-      //Hold all calculated light / shadow transformation matrices
+      //Hold all calculated light / shadow transformation matrices, 6 per light in tracker order
       glm::mat4 lightTransforms[lightTrackerMap.size()][6];
-      int lightTransformIds[lightTrackerMap.size()];
 
       //Repack light sources into ShaderData (uses vec4s for OpenGL)
       #pragma omp parallel for
@@ -142,7 +143,6 @@ namespace ammonite {
 
         //Calculate shadow transforms for shadows
         glm::vec3 lightPos = lightSource->geometry;
-        lightTransformIds[i] = lightSource->lightId;
         lightTransforms[i][0] = shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(1.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0));
         lightTransforms[i][1] = shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(-1.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0));
         lightTransforms[i][2] = shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0, 1.0, 0.0), glm::vec3(0.0, 0.0, 1.0));
@@ -158,27 +158,29 @@ namespace ammonite {
         shaderData[i].power[0] = lightSource->power;
       }
 
-      //Copy calculated tranforms to map
-      for (unsigned int i = 0; i < lightTrackerMap.size(); i++) {
-        memcpy(lightTransformMap[lightTransformIds[i]], lightTransforms[i], sizeof(glm::mat4) * 6);
-      }
-
-      //If the light count hasn't changed, sub the data instead of recreating the buffer
+      //If the light count hasn't changed, sub the data instead of recreating the buffers
       if (prevLightCount == lightTrackerMap.size()) {
         glNamedBufferSubData(lightDataId, 0, sizeof(shaderData), &shaderData);
+        glNamedBufferSubData(lightTransformsId, 0, sizeof(lightTransforms), &lightTransforms);
+        ammonite::renderStats::countBufferUpload(sizeof(shaderData) + sizeof(lightTransforms));
       } else {
-        //If the buffer already exists, destroy it
+        //If the buffers already exist, destroy them
         if (lightDataId != 0) {
           glDeleteBuffers(1, &lightDataId);
+          glDeleteBuffers(1, &lightTransformsId);
         }
 
-        //Add the shader data to a shader storage buffer object
+        //Add the shader data and shadow transforms to shader storage buffer objects
         glCreateBuffers(1, &lightDataId);
         glNamedBufferData(lightDataId, sizeof(shaderData), &shaderData, GL_STATIC_DRAW);
+        glCreateBuffers(1, &lightTransformsId);
+        glNamedBufferData(lightTransformsId, sizeof(lightTransforms), &lightTransforms, GL_STATIC_DRAW);
+        ammonite::renderStats::countBufferUpload(sizeof(shaderData) + sizeof(lightTransforms));
       }
 
-      //Use the lighting shader storage buffer
+      //Use the lighting and shadow transform shader storage buffers
       glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, lightDataId);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, lightTransformsId);
 
       //Update previous light count for next run
       prevLightCount = lightTrackerMap.size();
@@ -234,13 +236,6 @@ namespace ammonite {
         //Remove the light source from the tracker
         lightTrackerMap.erase(lightId);
       }
-
-      //Remove any light transform entry
-      auto transformIt = lightTransformMap.find(lightId);
-      if (transformIt != lightTransformMap.end()) {
-        //Remove the light source tranforms from the tracker
-        lightTransformMap.erase(lightId);
-      }
     }
 
     void setAmbientLight(glm::vec3 newAmbientLight) {
@@ -1,9 +1,14 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <algorithm>
 #include <cstring>
+#include <cstddef>
+#include <cmath>
 #include <string>
+#include <utility>
 
+#include <omp.h>
 #include <GL/glew.h>
 
 #include <assimp/Importer.hpp>
@@ -13,41 +18,105 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/quaternion.hpp>
+#include <glm/gtc/packing.hpp>
 
+#include "internal/internalSettings.hpp"
 #include "internal/textures.hpp"
 #include "internal/modelTracker.hpp"
+#include "internal/meshOptimiser.hpp"
+#include "internal/meshSimplifier.hpp"
+#include "internal/modelCache.hpp"
 #include "internal/lightTracker.hpp"
+#include "internal/residency.hpp"
+#include "internal/assetRegistry.hpp"
+#include "internal/renderStats.hpp"
+#include "utils/cacheManager.hpp"
 #include "utils/logging.hpp"
+#include "utils/profiler.hpp"
 
 #include "internal/internalDebug.hpp"
 
 namespace ammonite {
   namespace {
-    //Track all loaded models
-    std::map<int, models::ModelInfo> modelTrackerMap;
+    //Model handles hold a slot index in the low bits and the slot's generation above it
+    const int SLOT_INDEX_BITS = 20;
+    const unsigned int SLOT_INDEX_MASK = (1u << SLOT_INDEX_BITS) - 1;
+    const unsigned int MAX_GENERATION = (1u << (31 - SLOT_INDEX_BITS)) - 1;
+
+    struct ModelSlot {
+      unsigned int generation = 1;
+      int denseIndex = -1;
+    };
+
+    //Track all loaded models, densely packed, with slots to validate handles
+    std::vector<models::ModelInfo> modelInfos;
+    std::vector<unsigned int> denseSlots;
+    std::vector<ModelSlot> modelSlots;
+    std::vector<unsigned int> freeSlots;
     std::map<std::string, models::ModelData> modelDataMap;
 
     struct ModelLoadInfo {
       std::string modelDirectory;
       bool flipTexCoords;
       bool srgbTextures;
+      bool compactVertices;
+      bool optimiseMeshes;
+      bool optimiseOverdraw;
+      bool generateLods;
+      bool preserveHierarchy;
     };
 
     //Constants for loading assumptions
     const bool ASSUME_FLIP_UVS = true;
     const bool ASSUME_SRGB_TEXTURES = false;
+
+    //Bits of the packed load flags, for settings that change processed mesh data
+    const unsigned int FLIP_TEX_COORDS_FLAG = 1 << 0;
+    const unsigned int OPTIMISE_MESHES_FLAG = 1 << 1;
+    const unsigned int OPTIMISE_OVERDRAW_FLAG = 1 << 2;
+    const unsigned int GENERATE_LODS_FLAG = 1 << 3;
+    const unsigned int PRESERVE_HIERARCHY_FLAG = 1 << 4;
+
+    //Further bits for asset keys, these settings only change what's uploaded
+    const unsigned int SRGB_TEXTURES_FLAG = 1 << 5;
+    const unsigned int COMPACT_VERTICES_FLAG = 1 << 6;
   }
 
   //Internally exposed model handling methods
   namespace models {
+    //Pointers are only valid until the next model is created or deleted
     ModelInfo* getModelPtr(int modelId) {
-      //Check the model exists, and return a pointer
-      auto it = modelTrackerMap.find(modelId);
-      if (it != modelTrackerMap.end()) {
-        return &it->second;
-      } else {
+      if (modelId <= 0) {
         return nullptr;
       }
+
+      //Check the slot exists and hasn't been reused since the handle was created
+      unsigned int slotIndex = (unsigned int)modelId & SLOT_INDEX_MASK;
+      unsigned int generation = (unsigned int)modelId >> SLOT_INDEX_BITS;
+      if (slotIndex >= modelSlots.size()) {
+        return nullptr;
+      }
+
+      ModelSlot* slot = &modelSlots[slotIndex];
+      if (slot->generation != generation or slot->denseIndex == -1) {
+        return nullptr;
+      }
+
+      return &modelInfos[slot->denseIndex];
+    }
+
+    /*
+     - Fill modelPtrs with the active, loaded models from modelIds, skipping stale handles
+     - The pointers index the dense model storage, and share getModelPtr()'s lifetime
+    */
+    void getDrawableModels(const int modelIds[], int modelCount, std::vector<ModelInfo*>* modelPtrs) {
+      modelPtrs->clear();
+      for (int i = 0; i < modelCount; i++) {
+        ModelInfo* modelPtr = models::getModelPtr(modelIds[i]);
+        if (modelPtr != nullptr and modelPtr->isActive and modelPtr->isLoaded) {
+          modelPtrs->push_back(modelPtr);
+        }
+      }
     }
 
     void setLightEmitting(int modelId, bool lightEmitting) {
@@ -67,133 +136,384 @@ namespace ammonite {
   }
 
   namespace {
+    //Vectors are copied directly from Assimp, so it must use single precision floats
+    static_assert(sizeof(aiVector3D) == sizeof(glm::vec3), "aiVector3D must match glm::vec3");
+
+    //Map a unit vector onto an octahedron, then fold it into [-1, 1]^2
+    static glm::vec2 encodeOctahedral(glm::vec3 normal) {
+      float normalSum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+      if (normalSum == 0.0f) {
+        return glm::vec2(0.0f);
+      }
+
+      normal /= normalSum;
+      glm::vec2 encoded = glm::vec2(normal.x, normal.y);
+      if (normal.z < 0.0f) {
+        encoded.x = (1.0f - std::abs(normal.y)) * ((normal.x >= 0.0f) ? 1.0f : -1.0f);
+        encoded.y = (1.0f - std::abs(normal.x)) * ((normal.y >= 0.0f) ? 1.0f : -1.0f);
+      }
+
+      return encoded;
+    }
+
+    //Quantise a mesh's vertices, positions are stored relative to the mesh bounds
+    static void packCompactVertices(models::MeshData* meshData, std::vector<models::CompactVertexData>* compactData) {
+      glm::vec3 extent = meshData->boundsMax - meshData->boundsMin;
+      glm::vec3 inverseExtent = glm::vec3(0.0f);
+      for (int i = 0; i < 3; i++) {
+        if (extent[i] > 0.0f) {
+          inverseExtent[i] = 1.0f / extent[i];
+        }
+      }
+
+      compactData->resize(meshData->meshData.size());
+      for (unsigned int i = 0; i < meshData->meshData.size(); i++) {
+        models::VertexData* vertexData = &meshData->meshData[i];
+        glm::vec3 position = (vertexData->vertex - meshData->boundsMin) * inverseExtent;
+
+        (*compactData)[i].vertex = glm::packUnorm4x16(glm::vec4(position, 0.0f));
+        (*compactData)[i].normal = glm::packSnorm2x16(encodeOctahedral(vertexData->normal));
+        (*compactData)[i].texturePoint = glm::packHalf2x16(vertexData->texturePoint);
+      }
+    }
+
+    //Map compact positions from [0, 1] back onto the mesh bounds, identity for full precision positions
+    static glm::mat4 getDecodeMatrix(models::MeshData* meshData) {
+      glm::mat4 decodeMatrix = glm::mat4(1.0f);
+      if (meshData->compactVertices) {
+        glm::vec3 extent = meshData->boundsMax - meshData->boundsMin;
+        decodeMatrix[0][0] = extent.x;
+        decodeMatrix[1][1] = extent.y;
+        decodeMatrix[2][2] = extent.z;
+        decodeMatrix[3] = glm::vec4(meshData->boundsMin, 1.0f);
+      }
+
+      return decodeMatrix;
+    }
+
+    //Single identity transform, shared by every mesh that isn't instanced or compact
+    static GLuint getIdentityInstanceBuffer() {
+      static GLuint identityBufferId = 0;
+      if (identityBufferId == 0) {
+        models::InstanceData identityInstance = {glm::mat4(1.0f), glm::mat3(1.0f)};
+        glCreateBuffers(1, &identityBufferId);
+        glNamedBufferData(identityBufferId, sizeof(identityInstance), &identityInstance, GL_STATIC_DRAW);
+        ammonite::renderStats::countBufferUpload(sizeof(identityInstance));
+      }
+
+      return identityBufferId;
+    }
+
+    //Free the system memory copy of a model's meshes, it's read back from disk when needed
+    static void releaseMeshData(models::ModelData* modelObjectData) {
+      for (unsigned int i = 0; i < modelObjectData->meshes.size(); i++) {
+        models::MeshData* meshData = &modelObjectData->meshes[i];
+        meshData->meshData.clear();
+        meshData->meshData.shrink_to_fit();
+        meshData->indices.clear();
+        meshData->indices.shrink_to_fit();
+      }
+
+      modelObjectData->hasMeshData = false;
+    }
+
+    static void deleteBuffers(models::ModelData* modelObjectData) {
+      //Skip models that were already evicted
+      if (!modelObjectData->isResident) {
+        return;
+      }
+
+      //Delete created buffers and the VAO
+      for (unsigned int i = 0; i < modelObjectData->meshes.size(); i++) {
+        models::MeshData* meshData = &modelObjectData->meshes[i];
+
+        glDeleteBuffers(1, &meshData->vertexBufferId);
+        glDeleteBuffers(1, &meshData->elementBufferId);
+        glDeleteVertexArrays(1, &meshData->vertexArrayId);
+        if (meshData->instanceBufferId != 0) {
+          glDeleteBuffers(1, &meshData->instanceBufferId);
+          meshData->instanceBufferId = 0;
+        }
+      }
+
+      ammonite::residency::removeResource(modelObjectData);
+      modelObjectData->isResident = false;
+    }
+
+    //Release the GPU copy of a model, the mesh data is kept to upload it again when drawn
+    static void evictModel(void* resource) {
+      deleteBuffers((models::ModelData*)resource);
+    }
+
     static void createBuffers(models::ModelData* modelObjectData) {
+      //Skip models that are already on the GPU, or have nothing to upload
+      if (modelObjectData->isResident or !modelObjectData->hasMeshData) {
+        return;
+      }
+
       //Generate buffers for every mesh
+      long long modelBytes = 0;
       for (unsigned int i = 0; i < modelObjectData->meshes.size(); i++) {
         models::MeshData* meshData = &modelObjectData->meshes[i];
 
         //Create vertex and index buffers
         glCreateBuffers(2, &meshData->vertexBufferId);
 
-        //Fill interleaved vertex + normal + texture buffer and index buffer
-        glNamedBufferData(meshData->vertexBufferId, meshData->meshData.size() * sizeof(models::VertexData), &meshData->meshData[0], GL_STATIC_DRAW);
-        glNamedBufferData(meshData->elementBufferId, meshData->indices.size() * sizeof(unsigned int), &meshData->indices[0], GL_STATIC_DRAW);
+        //Fill interleaved vertex + normal + texture buffer
+        if (meshData->compactVertices) {
+          std::vector<models::CompactVertexData> compactData;
+          packCompactVertices(meshData, &compactData);
+          glNamedBufferData(meshData->vertexBufferId, compactData.size() * sizeof(models::CompactVertexData), &compactData[0], GL_STATIC_DRAW);
+          modelBytes += compactData.size() * sizeof(models::CompactVertexData);
+          ammonite::renderStats::countBufferUpload(compactData.size() * sizeof(models::CompactVertexData));
+        } else {
+          glNamedBufferData(meshData->vertexBufferId, meshData->meshData.size() * sizeof(models::VertexData), &meshData->meshData[0], GL_STATIC_DRAW);
+          modelBytes += meshData->meshData.size() * sizeof(models::VertexData);
+          ammonite::renderStats::countBufferUpload(meshData->meshData.size() * sizeof(models::VertexData));
+        }
+
+        //Fill index buffer, using 16-bit indices if every vertex can be addressed
+        if (meshData->meshData.size() <= 65536) {
+          std::vector<GLushort> shortIndices(meshData->indices.begin(), meshData->indices.end());
+          glNamedBufferData(meshData->elementBufferId, shortIndices.size() * sizeof(GLushort), &shortIndices[0], GL_STATIC_DRAW);
+          meshData->indexType = GL_UNSIGNED_SHORT;
+          modelBytes += shortIndices.size() * sizeof(GLushort);
+          ammonite::renderStats::countBufferUpload(shortIndices.size() * sizeof(GLushort));
+        } else {
+          glNamedBufferData(meshData->elementBufferId, meshData->indices.size() * sizeof(unsigned int), &meshData->indices[0], GL_STATIC_DRAW);
+          meshData->indexType = GL_UNSIGNED_INT;
+          modelBytes += meshData->indices.size() * sizeof(unsigned int);
+          ammonite::renderStats::countBufferUpload(meshData->indices.size() * sizeof(unsigned int));
+        }
 
         //Create the vertex attribute buffer
         glCreateVertexArrays(1, &meshData->vertexArrayId);
 
         GLuint vaoId = meshData->vertexArrayId;
         GLuint vboId = meshData->vertexBufferId;
-        int stride = 8 * sizeof(float); //(3 + 3 + 2) * bytes per float
-
-        //Vertex attribute
-        glEnableVertexArrayAttrib(vaoId, 0);
-        glVertexArrayVertexBuffer(vaoId, 0, vboId, 0, stride);
-        glVertexArrayAttribFormat(vaoId, 0, 3, GL_FLOAT, GL_FALSE, 0);
-        glVertexArrayAttribBinding(vaoId, 0, 0);
-
-        //Normal attribute
-        glEnableVertexArrayAttrib(vaoId, 1);
-        glVertexArrayVertexBuffer(vaoId, 1, vboId, 3 * sizeof(float), stride);
-        glVertexArrayAttribFormat(vaoId, 1, 3, GL_FLOAT, GL_FALSE, 0);
-        glVertexArrayAttribBinding(vaoId, 1, 1);
-
-        //Texture attribute
-        glEnableVertexArrayAttrib(vaoId, 2);
-        glVertexArrayVertexBuffer(vaoId, 2, vboId, 6 * sizeof(float), stride);
-        glVertexArrayAttribFormat(vaoId, 2, 2, GL_FLOAT, GL_FALSE, 0);
-        glVertexArrayAttribBinding(vaoId, 2, 2);
+
+        if (meshData->compactVertices) {
+          int stride = sizeof(models::CompactVertexData); //8 + 4 + 4 bytes
+
+          //Vertex attribute, the 4th component is 0 so shaders can tell the vertices are compact
+          glEnableVertexArrayAttrib(vaoId, 0);
+          glVertexArrayVertexBuffer(vaoId, 0, vboId, offsetof(models::CompactVertexData, vertex), stride);
+          glVertexArrayAttribFormat(vaoId, 0, 4, GL_UNSIGNED_SHORT, GL_TRUE, 0);
+          glVertexArrayAttribBinding(vaoId, 0, 0);
+
+          //Normal attribute
+          glEnableVertexArrayAttrib(vaoId, 1);
+          glVertexArrayVertexBuffer(vaoId, 1, vboId, offsetof(models::CompactVertexData, normal), stride);
+          glVertexArrayAttribFormat(vaoId, 1, 2, GL_SHORT, GL_TRUE, 0);
+          glVertexArrayAttribBinding(vaoId, 1, 1);
+
+          //Texture attribute
+          glEnableVertexArrayAttrib(vaoId, 2);
+          glVertexArrayVertexBuffer(vaoId, 2, vboId, offsetof(models::CompactVertexData, texturePoint), stride);
+          glVertexArrayAttribFormat(vaoId, 2, 2, GL_HALF_FLOAT, GL_FALSE, 0);
+          glVertexArrayAttribBinding(vaoId, 2, 2);
+        } else {
+          int stride = 8 * sizeof(float); //(3 + 3 + 2) * bytes per float
+
+          //Vertex attribute
+          glEnableVertexArrayAttrib(vaoId, 0);
+          glVertexArrayVertexBuffer(vaoId, 0, vboId, 0, stride);
+          glVertexArrayAttribFormat(vaoId, 0, 3, GL_FLOAT, GL_FALSE, 0);
+          glVertexArrayAttribBinding(vaoId, 0, 0);
+
+          //Normal attribute
+          glEnableVertexArrayAttrib(vaoId, 1);
+          glVertexArrayVertexBuffer(vaoId, 1, vboId, 3 * sizeof(float), stride);
+          glVertexArrayAttribFormat(vaoId, 1, 3, GL_FLOAT, GL_FALSE, 0);
+          glVertexArrayAttribBinding(vaoId, 1, 1);
+
+          //Texture attribute
+          glEnableVertexArrayAttrib(vaoId, 2);
+          glVertexArrayVertexBuffer(vaoId, 2, vboId, 6 * sizeof(float), stride);
+          glVertexArrayAttribFormat(vaoId, 2, 2, GL_FLOAT, GL_FALSE, 0);
+          glVertexArrayAttribBinding(vaoId, 2, 2);
+        }
 
         //Element buffer
         glVertexArrayElementBuffer(vaoId, meshData->elementBufferId);
+
+        /*
+         - Upload instance transforms, meshes without any use the shared identity instance
+         - Compact positions are dequantised by their instance transforms, so they always get their own
+        */
+        GLuint instanceBufferId = getIdentityInstanceBuffer();
+        if (!meshData->instanceTransforms.empty() or meshData->compactVertices) {
+          glm::mat4 decodeMatrix = getDecodeMatrix(meshData);
+          std::vector<models::InstanceData> instanceData(std::max(meshData->instanceTransforms.size(), std::size_t(1)));
+          for (unsigned int j = 0; j < instanceData.size(); j++) {
+            glm::mat4 transform = glm::mat4(1.0f);
+            if (!meshData->instanceTransforms.empty()) {
+              transform = meshData->instanceTransforms[j];
+            }
+
+            instanceData[j].transform = transform * decodeMatrix;
+            instanceData[j].normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+          }
+
+          glCreateBuffers(1, &meshData->instanceBufferId);
+          glNamedBufferData(meshData->instanceBufferId, instanceData.size() * sizeof(models::InstanceData), &instanceData[0], GL_STATIC_DRAW);
+          modelBytes += instanceData.size() * sizeof(models::InstanceData);
+          ammonite::renderStats::countBufferUpload(instanceData.size() * sizeof(models::InstanceData));
+          instanceBufferId = meshData->instanceBufferId;
+        }
+
+        //Instance attributes, a column per location
+        glVertexArrayVertexBuffer(vaoId, 3, instanceBufferId, 0, sizeof(models::InstanceData));
+        glVertexArrayBindingDivisor(vaoId, 3, 1);
+        for (int column = 0; column < 4; column++) {
+          glEnableVertexArrayAttrib(vaoId, 3 + column);
+          glVertexArrayAttribFormat(vaoId, 3 + column, 4, GL_FLOAT, GL_FALSE, offsetof(models::InstanceData, transform) + column * sizeof(glm::vec4));
+          glVertexArrayAttribBinding(vaoId, 3 + column, 3);
+        }
+
+        for (int column = 0; column < 3; column++) {
+          glEnableVertexArrayAttrib(vaoId, 7 + column);
+          glVertexArrayAttribFormat(vaoId, 7 + column, 3, GL_FLOAT, GL_FALSE, offsetof(models::InstanceData, normalMatrix) + column * sizeof(glm::vec3));
+          glVertexArrayAttribBinding(vaoId, 7 + column, 3);
+        }
       }
-    }
 
-    static void deleteBuffers(models::ModelData* modelObjectData) {
-      //Delete created buffers and the VAO
-      for (unsigned int i = 0; i < modelObjectData->meshes.size(); i++) {
-        models::MeshData* meshData = &modelObjectData->meshes[i];
+      //Track the buffers against the memory budget
+      modelObjectData->isResident = true;
+      ammonite::residency::addResource(modelObjectData, modelBytes, &modelObjectData->lastUsedFrame, evictModel);
 
-        glDeleteBuffers(1, &meshData->vertexBufferId);
-        glDeleteBuffers(1, &meshData->elementBufferId);
-        glDeleteVertexArrays(1, &meshData->vertexArrayId);
+      if (!modelObjectData->retainMeshData) {
+        releaseMeshData(modelObjectData);
       }
     }
 
-    static void processMesh(aiMesh* mesh, const aiScene* scene, std::vector<models::MeshData>* meshes, std::vector<GLuint>* textureIds, ModelLoadInfo modelLoadInfo, bool* externalSuccess) {
-      //Add a new empty mesh to the mesh vector
-      meshes->emplace_back();
-      models::MeshData* newMesh = &meshes->back();
+    //Pack the settings that change processed mesh data, to validate cached models
+    static unsigned int getLoadFlags(const ModelLoadInfo* modelLoadInfo) {
+      return (modelLoadInfo->flipTexCoords ? FLIP_TEX_COORDS_FLAG : 0) |
+             (modelLoadInfo->optimiseMeshes ? OPTIMISE_MESHES_FLAG : 0) |
+             (modelLoadInfo->optimiseOverdraw ? OPTIMISE_OVERDRAW_FLAG : 0) |
+             (modelLoadInfo->generateLods ? GENERATE_LODS_FLAG : 0) |
+             (modelLoadInfo->preserveHierarchy ? PRESERVE_HIERARCHY_FLAG : 0);
+    }
 
-      //Fill the mesh with vertex data
-      for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
-        models::VertexData vertexData;
+    //Unpack settings packed by getLoadFlags()
+    static void setLoadFlags(ModelLoadInfo* modelLoadInfo, unsigned int loadFlags) {
+      modelLoadInfo->flipTexCoords = loadFlags & FLIP_TEX_COORDS_FLAG;
+      modelLoadInfo->optimiseMeshes = loadFlags & OPTIMISE_MESHES_FLAG;
+      modelLoadInfo->optimiseOverdraw = loadFlags & OPTIMISE_OVERDRAW_FLAG;
+      modelLoadInfo->generateLods = loadFlags & GENERATE_LODS_FLAG;
+      modelLoadInfo->preserveHierarchy = loadFlags & PRESERVE_HIERARCHY_FLAG;
+    }
 
-        vertexData.vertex.x = mesh->mVertices[i].x;
-        vertexData.vertex.y = mesh->mVertices[i].y;
-        vertexData.vertex.z = mesh->mVertices[i].z;
+    static void processMesh(const aiMesh* mesh, const aiScene* scene, models::MeshData* newMesh, std::string* texturePath, const ModelLoadInfo* modelLoadInfo) {
+      /*
+       - Size the vertices up front, then interleave every attribute in a single pass
+       - Each source stream is read in order, but the output is strided, so this is a plain loop
+       - Missing normals and texture coordinates are zero filled
+      */
+      std::vector<models::VertexData>* vertices = &newMesh->meshData;
+      vertices->resize(mesh->mNumVertices);
+      const aiVector3D* positions = mesh->mVertices;
+      const aiVector3D* normals = mesh->mNormals;
+      const aiVector3D* texCoords = mesh->mTextureCoords[0];
+      for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+        models::VertexData* vertex = &(*vertices)[i];
+        vertex->vertex = glm::vec3(positions[i].x, positions[i].y, positions[i].z);
+        vertex->normal = (normals != nullptr) ? glm::vec3(normals[i].x, normals[i].y, normals[i].z) : glm::vec3(0.0f);
+        vertex->texturePoint = (texCoords != nullptr) ? glm::vec2(texCoords[i].x, texCoords[i].y) : glm::vec2(0.0f);
+      }
 
-        vertexData.normal.x = mesh->mNormals[i].x;
-        vertexData.normal.y = mesh->mNormals[i].y;
-        vertexData.normal.z = mesh->mNormals[i].z;
+      //Count and copy the indices of every face
+      unsigned int indexCount = 0;
+      for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+        indexCount += mesh->mFaces[i].mNumIndices;
+      }
 
-        if (mesh->mTextureCoords[0]) {
-          vertexData.texturePoint.x = mesh->mTextureCoords[0][i].x;
-          vertexData.texturePoint.y = mesh->mTextureCoords[0][i].y;
-        } else {
-          vertexData.texturePoint = glm::vec2(0.0f);
-        }
+      newMesh->indices.resize(indexCount);
+      unsigned int* indexPtr = newMesh->indices.data();
+      for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+        const aiFace* face = &mesh->mFaces[i];
+        std::memcpy(indexPtr, face->mIndices, face->mNumIndices * sizeof(unsigned int));
+        indexPtr += face->mNumIndices;
+      }
+      newMesh->vertexCount = indexCount;
 
-        newMesh->meshData.push_back(vertexData);
+      //Reorder triangle meshes for the post-transform cache and vertex fetches
+      bool isTriangleMesh = (mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE);
+      if (modelLoadInfo->optimiseMeshes and isTriangleMesh) {
+        ammonite::models::optimisation::optimiseMesh(newMesh, modelLoadInfo->optimiseOverdraw);
       }
 
-      //Fill mesh indices
-      for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
-        aiFace face = mesh->mFaces[i];
-        for (unsigned int j = 0; j < face.mNumIndices; j++) {
-          newMesh->indices.push_back(face.mIndices[j]);
+      //Find the bounds of the mesh, used to quantise compact vertices and select LODs
+      if (newMesh->meshData.size() > 0) {
+        newMesh->boundsMin = newMesh->meshData[0].vertex;
+        newMesh->boundsMax = newMesh->meshData[0].vertex;
+        for (unsigned int i = 1; i < newMesh->meshData.size(); i++) {
+          newMesh->boundsMin = glm::min(newMesh->boundsMin, newMesh->meshData[i].vertex);
+          newMesh->boundsMax = glm::max(newMesh->boundsMax, newMesh->meshData[i].vertex);
         }
       }
-      newMesh->vertexCount = newMesh->indices.size();
 
-      //Load any diffuse texture given
+      //Every mesh can be drawn at full detail, simplified levels follow
+      newMesh->lodLevels.push_back({0, newMesh->vertexCount, 0.0f});
+      if (modelLoadInfo->generateLods and isTriangleMesh) {
+        ammonite::models::simplification::generateLods(newMesh);
+      }
+
+      //Record any diffuse texture given, loaded once every mesh is processed
+      //Meshes without a texture keep an empty path, to keep pace with meshes
       aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
       if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
-        aiString texturePath;
-        material->GetTexture(aiTextureType_DIFFUSE, 0, &texturePath);
+        aiString aiTexturePath;
+        material->GetTexture(aiTextureType_DIFFUSE, 0, &aiTexturePath);
 
-        std::string fullTexturePath = modelLoadInfo.modelDirectory + '/' + texturePath.C_Str();
+        *texturePath = modelLoadInfo->modelDirectory + '/' + aiTexturePath.C_Str();
+      }
+    }
 
-        bool hasCreatedTexture = true;
-        int textureId = ammonite::textures::loadTexture(fullTexturePath.c_str(), modelLoadInfo.srgbTextures, &hasCreatedTexture);
-        if (!hasCreatedTexture) {
-          *externalSuccess = false;
-          return;
-        }
+    //Collect meshes in node order, so they can be processed independently
+    static void findMeshes(const aiNode* node, const aiScene* scene, std::vector<const aiMesh*>* sceneMeshes) {
+      for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+        sceneMeshes->push_back(scene->mMeshes[node->mMeshes[i]]);
+      }
 
-        textureIds->push_back(textureId);
-      } else {
-        //Add an empty texture to the tracker, to keep pace with meshes
-        textureIds->push_back(0);
+      for (unsigned int i = 0; i < node->mNumChildren; i++) {
+        findMeshes(node->mChildren[i], scene, sceneMeshes);
       }
     }
 
-    static void processNode(aiNode* node, const aiScene* scene, std::vector<models::MeshData>* meshes, std::vector<GLuint>* textureIds, ModelLoadInfo modelLoadInfo, bool* externalSuccess) {
+    //Assimp matrices are row-major, glm matrices are column-major
+    static glm::mat4 convertMatrix(const aiMatrix4x4* matrix) {
+      return glm::mat4(glm::vec4(matrix->a1, matrix->b1, matrix->c1, matrix->d1),
+                       glm::vec4(matrix->a2, matrix->b2, matrix->c2, matrix->d2),
+                       glm::vec4(matrix->a3, matrix->b3, matrix->c3, matrix->d3),
+                       glm::vec4(matrix->a4, matrix->b4, matrix->c4, matrix->d4));
+    }
+
+    //Collect the transform of every node using each mesh, relative to the root node
+    static void findInstances(const aiNode* node, glm::mat4 parentTransform, std::vector<std::vector<glm::mat4>>* meshInstances) {
+      glm::mat4 nodeTransform = parentTransform * convertMatrix(&node->mTransformation);
       for (unsigned int i = 0; i < node->mNumMeshes; i++) {
-        processMesh(scene->mMeshes[node->mMeshes[i]], scene, meshes, textureIds, modelLoadInfo, externalSuccess);
+        (*meshInstances)[node->mMeshes[i]].push_back(nodeTransform);
       }
 
       for (unsigned int i = 0; i < node->mNumChildren; i++) {
-        processNode(node->mChildren[i], scene, meshes, textureIds, modelLoadInfo, externalSuccess);
+        findInstances(node->mChildren[i], nodeTransform, meshInstances);
       }
     }
 
-    static void loadObject(const char* objectPath, models::ModelData* modelObjectData, std::vector<GLuint>* textureIds, ModelLoadInfo modelLoadInfo, bool* externalSuccess) {
+    static void loadObject(const char* objectPath, models::ModelData* modelObjectData, std::vector<std::string>* texturePaths, const ModelLoadInfo* modelLoadInfo, bool* externalSuccess) {
+      ammoniteProfileZone("loadObject");
       //Generate postprocessing flags
-      auto aiProcessFlags = aiProcess_Triangulate | aiProcess_GenNormals | aiProcess_GenUVCoords | aiProcess_RemoveRedundantMaterials | aiProcess_OptimizeMeshes | aiProcess_JoinIdenticalVertices | aiProcess_PreTransformVertices;
+      auto aiProcessFlags = aiProcess_Triangulate | aiProcess_GenNormals | aiProcess_GenUVCoords | aiProcess_RemoveRedundantMaterials | aiProcess_OptimizeMeshes | aiProcess_JoinIdenticalVertices;
+
+      //Bake node transforms into a copy of each mesh, unless meshes should be instanced
+      if (!modelLoadInfo->preserveHierarchy) {
+        aiProcessFlags = aiProcessFlags | aiProcess_PreTransformVertices;
+      }
 
       //Flip texture coords, if requested
-      if (modelLoadInfo.flipTexCoords) {
+      if (modelLoadInfo->flipTexCoords) {
         aiProcessFlags = aiProcessFlags | aiProcess_FlipUVs;
       }
 
@@ -207,74 +527,380 @@ namespace ammonite {
         return;
       }
 
-      //Recursively process nodes
-      processNode(scene->mRootNode, scene, &modelObjectData->meshes, textureIds, modelLoadInfo, externalSuccess);
+      //Recursively find meshes, then size the outputs so each mesh has a slot
+      std::vector<const aiMesh*> sceneMeshes;
+      std::vector<std::vector<glm::mat4>> meshInstances;
+      if (modelLoadInfo->preserveHierarchy) {
+        std::vector<std::vector<glm::mat4>> sceneInstances(scene->mNumMeshes);
+        findInstances(scene->mRootNode, glm::mat4(1.0f), &sceneInstances);
+
+        //Keep one copy of every mesh used by a node
+        for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+          if (!sceneInstances[i].empty()) {
+            sceneMeshes.push_back(scene->mMeshes[i]);
+            meshInstances.push_back(std::move(sceneInstances[i]));
+          }
+        }
+      } else {
+        findMeshes(scene->mRootNode, scene, &sceneMeshes);
+      }
+
+      const int meshCount = sceneMeshes.size();
+      modelObjectData->meshes.resize(meshCount);
+      texturePaths->resize(meshCount);
+
+      //Use 1 thread per mesh, up to the OpenMP limit (hardware maximum, unless set lower)
+      int threadCount = std::min(meshCount, omp_get_max_threads());
+      threadCount = std::max(threadCount, 1);
+
+      //Meshes share no data, so convert, optimise and simplify them in parallel
+      #pragma omp parallel for schedule(dynamic) num_threads(threadCount)
+      for (int i = 0; i < meshCount; i++) {
+        processMesh(sceneMeshes[i], scene, &modelObjectData->meshes[i], &(*texturePaths)[i], modelLoadInfo);
+      }
+
+      //Report what each mesh was reduced to, after the threads so the output isn't interleaved
+      for (int i = 0; i < meshCount; i++) {
+        models::MeshData* meshData = &modelObjectData->meshes[i];
+        if (meshData->originalAcmr != 0.0f) {
+          ammoniteInternalDebug << "Optimised mesh ACMR: " << meshData->originalAcmr << " -> " << meshData->optimisedAcmr << std::endl;
+        }
+
+        for (unsigned int level = 1; level < meshData->lodLevels.size(); level++) {
+          ammoniteInternalDebug << "Generated LOD " << level << ": " << meshData->lodLevels[level].indexCount / 3
+                                << " triangles, error " << meshData->lodLevels[level].error << std::endl;
+        }
+      }
+
+      for (unsigned int i = 0; i < meshInstances.size(); i++) {
+        modelObjectData->meshes[i].instanceTransforms = std::move(meshInstances[i]);
+      }
+    }
+
+    static void loadTextures(std::vector<std::string>* texturePaths, std::vector<GLuint>* textureIds, bool srgbTextures, bool* externalSuccess) {
+      for (unsigned int i = 0; i < texturePaths->size(); i++) {
+        //Add an empty texture to the tracker, to keep pace with meshes
+        if ((*texturePaths)[i].empty()) {
+          textureIds->push_back(0);
+          continue;
+        }
+
+        bool hasCreatedTexture = true;
+        int textureId = ammonite::textures::loadTexture((*texturePaths)[i].c_str(), srgbTextures, &hasCreatedTexture);
+        if (!hasCreatedTexture) {
+          *externalSuccess = false;
+          return;
+        }
+
+        textureIds->push_back(textureId);
+      }
+    }
+
+    //Find a bounding sphere for the model, and the largest error at each level of detail
+    static void calcModelBounds(models::ModelData* modelObjectData) {
+      glm::vec3 boundsMin = glm::vec3(0.0f);
+      glm::vec3 boundsMax = glm::vec3(0.0f);
+      bool hasBounds = false;
+      unsigned int lodCount = 0;
+
+      for (unsigned int i = 0; i < modelObjectData->meshes.size(); i++) {
+        models::MeshData* meshData = &modelObjectData->meshes[i];
+        lodCount = std::max(lodCount, (unsigned int)meshData->lodLevels.size());
+        if (meshData->meshData.empty()) {
+          continue;
+        }
+
+        if (meshData->instanceTransforms.empty()) {
+          boundsMin = hasBounds ? glm::min(boundsMin, meshData->boundsMin) : meshData->boundsMin;
+          boundsMax = hasBounds ? glm::max(boundsMax, meshData->boundsMax) : meshData->boundsMax;
+          hasBounds = true;
+          continue;
+        }
+
+        //Include the corners of every instance's transformed bounding box
+        for (unsigned int j = 0; j < meshData->instanceTransforms.size(); j++) {
+          for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 point = glm::vec3((corner & 1) ? meshData->boundsMax.x : meshData->boundsMin.x,
+                                        (corner & 2) ? meshData->boundsMax.y : meshData->boundsMin.y,
+                                        (corner & 4) ? meshData->boundsMax.z : meshData->boundsMin.z);
+            point = glm::vec3(meshData->instanceTransforms[j] * glm::vec4(point, 1.0f));
+            boundsMin = hasBounds ? glm::min(boundsMin, point) : point;
+            boundsMax = hasBounds ? glm::max(boundsMax, point) : point;
+            hasBounds = true;
+          }
+        }
+      }
+
+      modelObjectData->boundsCentre = (boundsMin + boundsMax) / 2.0f;
+      modelObjectData->boundsRadius = glm::length(boundsMax - boundsMin) / 2.0f;
+
+      //Meshes with fewer levels keep using their simplest level
+      modelObjectData->lodErrors.assign(lodCount, 0.0f);
+      for (unsigned int i = 0; i < modelObjectData->meshes.size(); i++) {
+        models::MeshData* meshData = &modelObjectData->meshes[i];
+
+        //Instances scale the error by their largest axis
+        float errorScale = meshData->instanceTransforms.empty() ? 1.0f : 0.0f;
+        for (unsigned int j = 0; j < meshData->instanceTransforms.size(); j++) {
+          glm::mat4* transform = &meshData->instanceTransforms[j];
+          errorScale = std::max(errorScale, std::max(glm::length(glm::vec3((*transform)[0])),
+                                                     std::max(glm::length(glm::vec3((*transform)[1])),
+                                                              glm::length(glm::vec3((*transform)[2])))));
+        }
+
+        std::vector<models::LodLevel>* lodLevels = &meshData->lodLevels;
+        for (unsigned int level = 0; level < lodCount and !lodLevels->empty(); level++) {
+          float error = (*lodLevels)[std::min(level, (unsigned int)lodLevels->size() - 1)].error * errorScale;
+          modelObjectData->lodErrors[level] = std::max(modelObjectData->lodErrors[level], error);
+        }
+      }
+    }
+
+    /*
+     - Read released mesh data back from the cache or the model file, with the original settings
+     - Without the cache enabled, this repeats the full import, including vertex cache
+       optimisation and level of detail simplification, every time a released model is drawn
+    */
+    static bool fetchMeshData(models::ModelData* modelObjectData) {
+      const char* objectPath = modelObjectData->modelName.c_str();
+      const unsigned int loadFlags = modelObjectData->loadFlags;
+
+      ModelLoadInfo modelLoadInfo;
+      modelLoadInfo.modelDirectory = modelObjectData->modelName.substr(0, modelObjectData->modelName.find_last_of('/'));
+      setLoadFlags(&modelLoadInfo, loadFlags);
+
+      models::ModelData fetchedData;
+      std::vector<std::string> texturePaths;
+      bool hasFetchedData = true;
+      if (!ammonite::utils::cache::getCacheEnabled() or
+          !models::cache::loadCachedModel(objectPath, loadFlags, &fetchedData, &texturePaths)) {
+        loadObject(objectPath, &fetchedData, &texturePaths, &modelLoadInfo, &hasFetchedData);
+      }
+
+      //The model file may have changed since it was loaded
+      if (!hasFetchedData or fetchedData.meshes.size() != modelObjectData->meshes.size()) {
+        std::cerr << ammonite::utils::warning << "Failed to reload mesh data for '" << objectPath << "'" << std::endl;
+        return false;
+      }
+
+      //Draw data for this frame was already laid out for the existing instances
+      for (unsigned int i = 0; i < modelObjectData->meshes.size(); i++) {
+        if (fetchedData.meshes[i].instanceTransforms.size() !=
+            modelObjectData->meshes[i].instanceTransforms.size()) {
+          std::cerr << ammonite::utils::warning << "Failed to reload mesh data for '" << objectPath << "'" << std::endl;
+          return false;
+        }
+      }
+
+      for (unsigned int i = 0; i < modelObjectData->meshes.size(); i++) {
+        models::MeshData* meshData = &modelObjectData->meshes[i];
+        models::MeshData* fetchedMesh = &fetchedData.meshes[i];
+        meshData->meshData = std::move(fetchedMesh->meshData);
+        meshData->indices = std::move(fetchedMesh->indices);
+        meshData->lodLevels = std::move(fetchedMesh->lodLevels);
+        meshData->instanceTransforms = std::move(fetchedMesh->instanceTransforms);
+        meshData->vertexCount = fetchedMesh->vertexCount;
+        meshData->boundsMin = fetchedMesh->boundsMin;
+        meshData->boundsMax = fetchedMesh->boundsMax;
+        meshData->originalAcmr = fetchedMesh->originalAcmr;
+        meshData->optimisedAcmr = fetchedMesh->optimisedAcmr;
+      }
+
+      //The meshes may have different bounds or levels of detail to the released data
+      calcModelBounds(modelObjectData);
+      modelObjectData->hasMeshData = true;
+      return true;
+    }
+
+    //Upload a model that isn't on the GPU, reading its mesh data back if it was released
+    static void restoreModel(models::ModelData* modelObjectData) {
+      if (!modelObjectData->hasMeshData and !fetchMeshData(modelObjectData)) {
+        return;
+      }
+
+      createBuffers(modelObjectData);
     }
   }
 
   //Exposed model handling methods
   namespace models {
     namespace {
-      static void calcModelMatrices(models::PositionData* positionData) {
-        //Recalculate the model matrix when a component changes
-        positionData->modelMatrix = positionData->translationMatrix * glm::toMat4(positionData->rotationQuat) * positionData->scaleMatrix;
+      static bool hasFreeSlot() {
+        if (freeSlots.empty() and modelSlots.size() > SLOT_INDEX_MASK) {
+          std::cerr << ammonite::utils::warning << "Failed to create model, too many models exist" << std::endl;
+          return false;
+        }
+
+        return true;
+      }
+
+      //Store a model in a free slot and return its handle, check hasFreeSlot() first
+      static int addModel(ModelInfo* modelObject) {
+        unsigned int slotIndex;
+        if (!freeSlots.empty()) {
+          slotIndex = freeSlots.back();
+          freeSlots.pop_back();
+        } else {
+          slotIndex = modelSlots.size();
+          modelSlots.emplace_back();
+        }
+
+        ModelSlot* slot = &modelSlots[slotIndex];
+        slot->denseIndex = modelInfos.size();
+        modelObject->modelId = int((slot->generation << SLOT_INDEX_BITS) | slotIndex);
 
-        //Normal matrix
-        positionData->normalMatrix = glm::transpose(glm::inverse(positionData->modelMatrix));
+        modelInfos.push_back(*modelObject);
+        denseSlots.push_back(slotIndex);
+        return modelObject->modelId;
       }
 
-      //Track cumulative number of created models
-      int totalModels = 0;
+      //Move the last model into the gap, then retire the slot's handle
+      static void removeModel(int modelId) {
+        unsigned int slotIndex = (unsigned int)modelId & SLOT_INDEX_MASK;
+        ModelSlot* slot = &modelSlots[slotIndex];
+        int lastIndex = modelInfos.size() - 1;
+        if (slot->denseIndex != lastIndex) {
+          modelInfos[slot->denseIndex] = std::move(modelInfos[lastIndex]);
+          denseSlots[slot->denseIndex] = denseSlots[lastIndex];
+          modelSlots[denseSlots[lastIndex]].denseIndex = slot->denseIndex;
+        }
+
+        modelInfos.pop_back();
+        denseSlots.pop_back();
+
+        //Generations skip 0, so a handle is never 0
+        slot->denseIndex = -1;
+        slot->generation = (slot->generation == MAX_GENERATION) ? 1 : slot->generation + 1;
+        freeSlots.push_back(slotIndex);
+      }
+    }
+
+    //Exposed internally, recalculate the model and normal matrices if a component changed
+    void updateModelMatrices(PositionData* positionData) {
+      if (!positionData->isDirty) {
+        return;
+      }
+
+      //Compose translation * rotation * scale by scaling the rotation's columns
+      glm::mat3 rotationMatrix = glm::toMat3(positionData->rotation);
+      glm::vec3 scale = positionData->scale;
+      positionData->modelMatrix = glm::mat4(glm::vec4(rotationMatrix[0] * scale.x, 0.0f),
+                                            glm::vec4(rotationMatrix[1] * scale.y, 0.0f),
+                                            glm::vec4(rotationMatrix[2] * scale.z, 0.0f),
+                                            glm::vec4(positionData->position, 1.0f));
+
+      //Inverse transpose of rotation * scale is rotation * inverse scale
+      positionData->normalMatrix = glm::mat3(rotationMatrix[0] / scale.x,
+                                             rotationMatrix[1] / scale.y,
+                                             rotationMatrix[2] / scale.z);
+      positionData->isDirty = false;
+    }
+
+    //Exposed internally, mark a model as drawn this frame and restore anything evicted
+    void markModelUsed(ModelInfo* modelPtr) {
+      ModelData* modelData = modelPtr->modelData;
+      if (!modelData->isResident) {
+        restoreModel(modelData);
+      }
+      modelData->lastUsedFrame = ammonite::residency::getCurrentFrame();
+
+      if (modelPtr->textureOverride != 0) {
+        ammonite::textures::markTextureUsed(modelPtr->textureOverride);
+        return;
+      }
+
+      for (unsigned int i = 0; i < modelData->textureIds.size(); i++) {
+        ammonite::textures::markTextureUsed(modelData->textureIds[i]);
+      }
     }
 
     int createModel(const char* objectPath, bool flipTexCoords, bool srgbTextures, bool* externalSuccess) {
+      ammoniteProfileZone("createModel");
+      if (!hasFreeSlot()) {
+        *externalSuccess = false;
+        return 0;
+      }
+
       //Create the model
       ModelInfo modelObject;
-      modelObject.modelName = std::string(objectPath);
+      std::string modelName = std::string(objectPath);
+
+      //Generate info required to load model
+      ModelLoadInfo modelLoadInfo;
+      modelLoadInfo.flipTexCoords = flipTexCoords;
+      modelLoadInfo.srgbTextures = srgbTextures;
+      modelLoadInfo.compactVertices = *ammonite::settings::models::internal::getCompactVerticesPtr();
+      modelLoadInfo.optimiseMeshes = *ammonite::settings::models::internal::getOptimiseMeshesPtr();
+      modelLoadInfo.optimiseOverdraw = *ammonite::settings::models::internal::getOptimiseOverdrawPtr();
+      modelLoadInfo.generateLods = *ammonite::settings::models::internal::getGenerateLodsPtr();
+      modelLoadInfo.preserveHierarchy = *ammonite::settings::models::internal::getPreserveHierarchyPtr();
+      modelLoadInfo.modelDirectory = modelName.substr(0, modelName.find_last_of('/'));
+      const unsigned int loadFlags = getLoadFlags(&modelLoadInfo);
+
+      //Only share model data loaded from the same contents and directory, with the same options
+      const unsigned int assetOptions = loadFlags |
+                                        (modelLoadInfo.srgbTextures ? SRGB_TEXTURES_FLAG : 0) |
+                                        (modelLoadInfo.compactVertices ? COMPACT_VERTICES_FLAG : 0);
+      std::string assetKey = ammonite::registry::getAssetKey(objectPath, assetOptions, true);
 
       //Reuse model data if it has already been loaded
-      auto it = modelDataMap.find(modelObject.modelName);
+      auto it = modelDataMap.find(assetKey);
+      ammonite::registry::recordRequest(ammonite::registry::MODEL_ASSET, it != modelDataMap.end());
       if (it != modelDataMap.end()) {
         modelObject.modelData = &it->second;
         modelObject.modelData->refCount++;
+
+        //Upload the data again if every other instance was unloaded
+        if (modelObject.modelData->refCount == 1) {
+          restoreModel(modelObject.modelData);
+        }
       } else {
         //Create empty ModelData object and add to tracker
         ModelData newModelData;
-        modelDataMap[modelObject.modelName] = newModelData;
-        modelObject.modelData = &modelDataMap[modelObject.modelName];
+        modelDataMap[assetKey] = newModelData;
+        modelObject.modelData = &modelDataMap[assetKey];
 
-        //Generate info required to load model
-        std::string pathString = objectPath;
-        ModelLoadInfo modelLoadInfo;
-        modelLoadInfo.flipTexCoords = flipTexCoords;
-        modelLoadInfo.srgbTextures = srgbTextures;
-        modelLoadInfo.modelDirectory = pathString.substr(0, pathString.find_last_of('/'));
-
-        //Fill the model data
+        //Fill the model data, using the cache when it matches the current settings
+        std::vector<std::string> texturePaths;
+        const bool isCacheEnabled = ammonite::utils::cache::getCacheEnabled();
         bool hasCreatedObject = true;
-        loadObject(objectPath, modelObject.modelData, &modelObject.textureIds, modelLoadInfo, &hasCreatedObject);
+        if (!isCacheEnabled or !cache::loadCachedModel(objectPath, loadFlags, modelObject.modelData, &texturePaths)) {
+          loadObject(objectPath, modelObject.modelData, &texturePaths, &modelLoadInfo, &hasCreatedObject);
+          if (hasCreatedObject and isCacheEnabled) {
+            cache::cacheModel(objectPath, loadFlags, modelObject.modelData, &texturePaths);
+          }
+        }
+
+        if (hasCreatedObject) {
+          loadTextures(&texturePaths, &modelObject.modelData->textureIds, modelLoadInfo.srgbTextures, &hasCreatedObject);
+        }
+
         if (!hasCreatedObject) {
-          modelDataMap.erase(modelObject.modelName);
+          modelDataMap.erase(assetKey);
           *externalSuccess = false;
           return 0;
         }
-        createBuffers(modelObject.modelData);
-      }
 
-      PositionData positionData;
-      positionData.translationMatrix = glm::mat4(1.0f);
-      positionData.scaleMatrix = glm::mat4(1.0f);
-      positionData.rotationQuat = glm::quat(glm::vec3(0, 0, 0));
+        //Vertex format is chosen at upload, so isn't part of the cache
+        for (unsigned int i = 0; i < modelObject.modelData->meshes.size(); i++) {
+          modelObject.modelData->meshes[i].compactVertices = modelLoadInfo.compactVertices;
+        }
 
-      modelObject.positionData = positionData;
+        //Remember how the data was created, so it can be read back after release
+        modelObject.modelData->modelName = modelName;
+        modelObject.modelData->assetKey = assetKey;
+        modelObject.modelData->loadFlags = loadFlags;
+        modelObject.modelData->retainMeshData = *ammonite::settings::models::internal::getRetainMeshDataPtr();
+
+        calcModelBounds(modelObject.modelData);
+        createBuffers(modelObject.modelData);
+      }
 
-      //Calculate model and normal matrices
-      calcModelMatrices(&modelObject.positionData);
+      //Matrices are calculated when the model is first drawn
+      modelObject.positionData = PositionData();
 
       //Add model to the tracker and return the ID
-      modelObject.modelId = ++totalModels;
-      modelTrackerMap[modelObject.modelId] = modelObject;
-      return modelObject.modelId;
+      return addModel(&modelObject);
     }
 
     int createModel(const char* objectPath, bool* externalSuccess) {
@@ -284,19 +910,26 @@ namespace ammonite {
     int copyModel(int modelId) {
       //Get the model and check it exists
       models::ModelInfo* oldModelObject = models::getModelPtr(modelId);
-      if (oldModelObject == nullptr) {
+      if (oldModelObject == nullptr or !hasFreeSlot()) {
         return 0;
       }
 
-      //Copy model data
+      //Copy model data, the copy is loaded even if the original isn't
       ModelInfo modelObject = *oldModelObject;
       modelObject.isLightEmitting = false;
+      modelObject.isLoaded = true;
       modelObject.modelData->refCount++;
+      if (modelObject.modelData->refCount == 1) {
+        restoreModel(modelObject.modelData);
+      }
+
+      //The copy holds its own reference to any applied texture
+      if (modelObject.textureOverride != 0) {
+        ammonite::textures::copyTexture(modelObject.textureOverride);
+      }
 
       //Add model to the tracker and return the ID
-      modelObject.modelId = ++totalModels;
-      modelTrackerMap[modelObject.modelId] = modelObject;
-      return modelObject.modelId;
+      return addModel(&modelObject);
     }
 
     void unloadModel(int modelId) {
@@ -338,16 +971,15 @@ namespace ammonite {
 
         //Upload actual data to the GPU, if it wasn't present
         if (modelPtr->modelData->refCount == 1) {
-          createBuffers(modelPtr->modelData);
+          restoreModel(modelPtr->modelData);
         }
       }
     }
 
     void deleteModel(int modelId) {
       //Check the model actually exists
-      auto it = modelTrackerMap.find(modelId);
-      if (it != modelTrackerMap.end()) {
-        ModelInfo* modelObject = &it->second;
+      ModelInfo* modelObject = models::getModelPtr(modelId);
+      if (modelObject != nullptr) {
         ModelData* modelObjectData = modelObject->modelData;
         //Decrease the reference / soft reference count of the model data
         if (modelObject->isLoaded) {
@@ -356,23 +988,28 @@ namespace ammonite {
           modelObjectData->softRefCount--;
         }
 
+        //Release the instance's applied texture
+        if (modelObject->textureOverride != 0) {
+          ammonite::textures::deleteTexture(modelObject->textureOverride);
+        }
+
         //If the model data is now unused, destroy it
         if (modelObjectData->refCount < 1 and modelObjectData->softRefCount < 1) {
           //Reduce reference count on textures
-          for (unsigned int i = 0; i < modelObjectData->meshes.size(); i++) {
-            ammonite::textures::deleteTexture(modelObject->textureIds[i]);
+          for (unsigned int i = 0; i < modelObjectData->textureIds.size(); i++) {
+            ammonite::textures::deleteTexture(modelObjectData->textureIds[i]);
           }
 
           //Destroy the model buffers and position in second tracker layer
           deleteBuffers(modelObjectData);
-          modelDataMap.erase(modelObject->modelName);
+          modelDataMap.erase(modelObjectData->assetKey);
         }
 
         //Unlink any attached light source
         ammonite::lighting::unlinkByModel(modelId);
 
         //Remove the model from the tracker
-        modelTrackerMap.erase(modelId);
+        removeModel(modelId);
       }
     }
 
@@ -383,25 +1020,21 @@ namespace ammonite {
         return;
       }
 
-      //Apply texture to every mesh on the model
-      ModelData* modelObjectData = modelPtr->modelData;
-      for (unsigned int i = 0; i < modelObjectData->meshes.size(); i++) {
-        //If a texture is already applied, remove it
-        if (modelPtr->textureIds[i] != 0) {
-          ammonite::textures::deleteTexture(modelPtr->textureIds[i]);
-          modelPtr->textureIds[i] = 0;
-        }
-
-        //Create new texture and apply to the mesh
-        bool hasCreatedTexture = true;
-        int textureId = ammonite::textures::loadTexture(texturePath, srgbTexture, &hasCreatedTexture);
-        if (!hasCreatedTexture) {
-          *externalSuccess = false;
-          return;
-        }
+      //Create new texture, keeping the current one if it fails
+      bool hasCreatedTexture = true;
+      GLuint textureId = ammonite::textures::loadTexture(texturePath, srgbTexture, &hasCreatedTexture);
+      if (!hasCreatedTexture) {
+        *externalSuccess = false;
+        return;
+      }
 
-        modelPtr->textureIds[i] = textureId;
+      //If a texture is already applied, remove it
+      if (modelPtr->textureOverride != 0) {
+        ammonite::textures::deleteTexture(modelPtr->textureOverride);
       }
+
+      //Apply the texture to every mesh of this instance
+      modelPtr->textureOverride = textureId;
     }
 
     void applyTexture(int modelId, const char* texturePath, bool* externalSuccess) {
@@ -424,6 +1057,72 @@ namespace ammonite {
       return vertexCount;
     }
 
+    //Return the average cache miss ratio of a model, before and after optimisation
+    void getCacheMissRatio(int modelId, float* originalAcmr, float* optimisedAcmr) {
+      *originalAcmr = 0.0f;
+      *optimisedAcmr = 0.0f;
+
+      ModelInfo* modelPtr = models::getModelPtr(modelId);
+      if (modelPtr == nullptr) {
+        return;
+      }
+
+      //Weight each mesh by its triangle count
+      int triangleCount = 0;
+      models::ModelData* modelData = modelPtr->modelData;
+      for (unsigned int i = 0; i < modelData->meshes.size(); i++) {
+        int meshTriangles = modelData->meshes[i].vertexCount / 3;
+        *originalAcmr += modelData->meshes[i].originalAcmr * meshTriangles;
+        *optimisedAcmr += modelData->meshes[i].optimisedAcmr * meshTriangles;
+        triangleCount += meshTriangles;
+      }
+
+      if (triangleCount != 0) {
+        *originalAcmr /= triangleCount;
+        *optimisedAcmr /= triangleCount;
+      }
+    }
+
+    //Choose whether a model keeps its mesh data in system memory after upload
+    void setRetainMeshData(int modelId, bool retainMeshData) {
+      ModelInfo* modelPtr = models::getModelPtr(modelId);
+      if (modelPtr == nullptr) {
+        return;
+      }
+
+      //Release the data now if it's already been uploaded
+      models::ModelData* modelData = modelPtr->modelData;
+      modelData->retainMeshData = retainMeshData;
+      if (!retainMeshData and modelData->isResident) {
+        releaseMeshData(modelData);
+      }
+    }
+
+    //Return how many model and texture loads reused data that was already loaded
+    void getReuseStats(int* modelRequests, int* modelReuses, int* textureRequests, int* textureReuses) {
+      ammonite::registry::getRequestStats(ammonite::registry::MODEL_ASSET, modelRequests, modelReuses);
+      ammonite::registry::getRequestStats(ammonite::registry::TEXTURE_ASSET, textureRequests, textureReuses);
+    }
+
+    //Return the system memory used by a model's mesh data
+    long long getRetainedBytes(int modelId) {
+      ModelInfo* modelPtr = models::getModelPtr(modelId);
+      if (modelPtr == nullptr) {
+        return 0;
+      }
+
+      long long retainedBytes = 0;
+      models::ModelData* modelData = modelPtr->modelData;
+      for (unsigned int i = 0; i < modelData->meshes.size(); i++) {
+        models::MeshData* meshData = &modelData->meshes[i];
+        retainedBytes += meshData->meshData.capacity() * sizeof(models::VertexData);
+        retainedBytes += meshData->indices.capacity() * sizeof(unsigned int);
+        retainedBytes += meshData->lodLevels.capacity() * sizeof(models::LodLevel);
+      }
+
+      return retainedBytes;
+    }
+
     namespace draw {
       void setDrawMode(int modelId, int drawMode) {
         ModelInfo* modelPtr = models::getModelPtr(modelId);
@@ -449,7 +1148,7 @@ namespace ammonite {
           return glm::vec3(0.0f);
         }
 
-        return glm::vec3(modelObject->positionData.translationMatrix * glm::vec4(glm::vec3(0, 0, 0), 1));
+        return modelObject->positionData.position;
       }
 
       glm::vec3 getScale(int modelId) {
@@ -459,7 +1158,7 @@ namespace ammonite {
           return glm::vec3(0.0f);
         }
 
-        return glm::vec3(modelObject->positionData.scaleMatrix * glm::vec4(glm::vec3(1, 1, 1), 1));
+        return modelObject->positionData.scale;
       }
 
       glm::vec3 getRotation(int modelId) {
@@ -469,7 +1168,7 @@ namespace ammonite {
           return glm::vec3(0.0f);
         }
 
-        return glm::degrees(glm::eulerAngles(modelObject->positionData.rotationQuat));
+        return glm::degrees(glm::eulerAngles(modelObject->positionData.rotation));
       }
     }
 
@@ -483,10 +1182,8 @@ namespace ammonite {
         }
 
         //Set the position
-        modelObject->positionData.translationMatrix = glm::translate(glm::mat4(1.0f), position);
-
-        //Recalculate model and normal matrices
-        calcModelMatrices(&modelObject->positionData);
+        modelObject->positionData.position = position;
+        modelObject->positionData.isDirty = true;
       }
 
       void setScale(int modelId, glm::vec3 scale) {
@@ -497,10 +1194,8 @@ namespace ammonite {
         }
 
         //Set the scale
-        modelObject->positionData.scaleMatrix = glm::scale(glm::mat4(1.0f), scale);
-
-        //Recalculate model and normal matrices
-        calcModelMatrices(&modelObject->positionData);
+        modelObject->positionData.scale = scale;
+        modelObject->positionData.isDirty = true;
       }
 
       void setScale(int modelId, float scaleMultiplier) {
@@ -518,10 +1213,43 @@ namespace ammonite {
         glm::vec3 rotationRadians = glm::vec3(glm::radians(rotation[0]),
                                               glm::radians(rotation[1]),
                                               glm::radians(rotation[2]));
-        modelObject->positionData.rotationQuat = glm::quat(rotationRadians) * glm::quat(glm::vec3(0, 0, 0));
+        modelObject->positionData.rotation = glm::quat(rotationRadians);
+        modelObject->positionData.isDirty = true;
+      }
+
+      /*
+       - Batched versions of the setters, for updating many models at once
+       - These only store the components, matrices are composed in parallel when drawn
+       - Invalid model IDs are skipped
+      */
+      void setPositions(const int modelIds[], const glm::vec3 positions[], const int modelCount) {
+        for (int i = 0; i < modelCount; i++) {
+          models::ModelInfo* modelObject = models::getModelPtr(modelIds[i]);
+          if (modelObject != nullptr) {
+            modelObject->positionData.position = positions[i];
+            modelObject->positionData.isDirty = true;
+          }
+        }
+      }
 
-        //Recalculate model and normal matrices
-        calcModelMatrices(&modelObject->positionData);
+      void setScales(const int modelIds[], const glm::vec3 scales[], const int modelCount) {
+        for (int i = 0; i < modelCount; i++) {
+          models::ModelInfo* modelObject = models::getModelPtr(modelIds[i]);
+          if (modelObject != nullptr) {
+            modelObject->positionData.scale = scales[i];
+            modelObject->positionData.isDirty = true;
+          }
+        }
+      }
+
+      void setRotations(const int modelIds[], const glm::vec3 rotations[], const int modelCount) {
+        for (int i = 0; i < modelCount; i++) {
+          models::ModelInfo* modelObject = models::getModelPtr(modelIds[i]);
+          if (modelObject != nullptr) {
+            modelObject->positionData.rotation = glm::quat(glm::radians(rotations[i]));
+            modelObject->positionData.isDirty = true;
+          }
+        }
       }
     }
 
@@ -535,12 +1263,8 @@ namespace ammonite {
         }
 
         //Translate it
-        modelObject->positionData.translationMatrix = glm::translate(
-          modelObject->positionData.translationMatrix,
-          translation);
-
-        //Recalculate model and normal matrices
-        calcModelMatrices(&modelObject->positionData);
+        modelObject->positionData.position += translation;
+        modelObject->positionData.isDirty = true;
       }
 
       void scaleModel(int modelId, glm::vec3 scaleVector) {
@@ -551,12 +1275,8 @@ namespace ammonite {
         }
 
         //Scale it
-        modelObject->positionData.scaleMatrix = glm::scale(
-          modelObject->positionData.scaleMatrix,
-          scaleVector);
-
-        //Recalculate model and normal matrices
-        calcModelMatrices(&modelObject->positionData);
+        modelObject->positionData.scale *= scaleVector;
+        modelObject->positionData.isDirty = true;
       }
 
       void scaleModel(int modelId, float scaleMultiplier) {
@@ -574,10 +1294,8 @@ namespace ammonite {
         glm::vec3 rotationRadians = glm::vec3(glm::radians(rotation[0]),
                                               glm::radians(rotation[1]),
                                               glm::radians(rotation[2]));
-        modelObject->positionData.rotationQuat = glm::quat(rotationRadians) * modelObject->positionData.rotationQuat;
-
-        //Recalculate model and normal matrices
-        calcModelMatrices(&modelObject->positionData);
+        modelObject->positionData.rotation = glm::quat(rotationRadians) * modelObject->positionData.rotation;
+        modelObject->positionData.isDirty = true;
       }
     }
   }
@@ -18,6 +18,10 @@ namespace ammonite {
     void applyTexture(int modelId, const char* texturePath, bool* externalSuccess);
     void applyTexture(int modelId, const char* texturePath, bool srgbTexture, bool* externalSuccess);
     int getVertexCount(int modelId);
+    void getCacheMissRatio(int modelId, float* originalAcmr, float* optimisedAcmr);
+    void setRetainMeshData(int modelId, bool retainMeshData);
+    long long getRetainedBytes(int modelId);
+    void getReuseStats(int* modelRequests, int* modelReuses, int* textureRequests, int* textureReuses);
 
     namespace draw {
       void setDrawMode(int modelId, int drawMode);
@@ -35,6 +39,11 @@ namespace ammonite {
       void setScale(int modelId, float scaleMultiplier);
       void setRotation(int modelId, glm::vec3 rotation);
 
+      //Batched absolute movements
+      void setPositions(const int modelIds[], const glm::vec3 positions[], const int modelCount);
+      void setScales(const int modelIds[], const glm::vec3 scales[], const int modelCount);
+      void setRotations(const int modelIds[], const glm::vec3 rotations[], const int modelCount);
+
       //Relative adjustments
       void translateModel(int modelId, glm::vec3 translation);
       void scaleModel(int modelId, glm::vec3 scale);
@@ -2,9 +2,10 @@
 #include <map>
 #include <vector>
 #include <string>
-#include <chrono>
-#include <thread>
 #include <cmath>
+#include <algorithm>
+
+#include <omp.h>
 
 #include <glm/glm.hpp>
 #include <GL/glew.h>
@@ -12,8 +13,15 @@
 
 #include "internal/internalSettings.hpp"
 #include "internal/modelTracker.hpp"
+#include "internal/textures.hpp"
 #include "internal/lightTracker.hpp"
 #include "internal/cameraMatrices.hpp"
+#include "internal/residency.hpp"
+#include "internal/framePacer.hpp"
+#include "internal/gpuTimer.hpp"
+#include "internal/frameStats.hpp"
+#include "internal/renderStats.hpp"
+#include "internal/headless.hpp"
 
 #include "settings.hpp"
 #include "shaders.hpp"
@@ -24,6 +32,7 @@
 #include "utils/timer.hpp"
 #include "utils/extension.hpp"
 #include "utils/logging.hpp"
+#include "utils/profiler.hpp"
 
 #include "internal/internalDebug.hpp"
 
@@ -33,40 +42,84 @@ namespace ammonite {
       GLFWwindow* window;
 
       //Structures to store uniform IDs for the shaders
-      struct {
+      struct ModelShader {
         GLuint shaderId;
-        GLuint matrixId;
-        GLuint modelMatrixId;
-        GLuint normalMatrixId;
-        GLuint ambientLightId;
-        GLuint cameraPosId;
-        GLuint farPlaneId;
-        GLuint lightCountId;
-        GLuint textureSamplerId;
+        GLuint drawIndexId;
+        GLuint texturePoolsId;
+        GLuint materialIndexId;
         GLuint shadowCubeMapId;
-      } modelShader;
+      };
+
+      //Model shader variants, the active variant and the textured / untextured variants for the scene
+      std::map<int, ModelShader> modelShaderVariants;
+      std::map<int, GLuint> pendingModelShaderVariants;
+      ModelShader* modelShader = nullptr;
+      ModelShader* sceneShaders[2] = {nullptr, nullptr};
+      std::string modelShaderPath;
+
+      //Whether the last model pass found any untextured meshes
+      bool hasUntexturedMeshes = false;
+
+      //Material index last sent to the bound model shader, reset whenever the program changes
+      GLuint sentMaterialIndex = 0;
+
+      //Meshes drawn by each sub-pass of the model pass
+      enum MaterialFilter {
+        ALL_MATERIALS,
+        TEXTURED_MATERIALS,
+        UNTEXTURED_MATERIALS
+      };
 
       struct {
         GLuint shaderId;
-        GLuint lightMatrixId;
+        GLuint drawIndexId;
         GLuint lightIndexId;
       } lightShader;
 
       struct {
         GLuint shaderId;
-        GLuint modelMatrixId;
-        GLuint farPlaneId;
+        GLuint drawIndexId;
         GLuint depthLightPosId;
         GLuint depthShadowIndex;
       } depthShader;
 
       struct {
         GLuint shaderId;
-        GLuint viewMatrixId;
-        GLuint projectionMatrixId;
         GLuint skyboxSamplerId;
       } skyboxShader;
 
+      //Per-frame constants, laid out to match the std140 FrameData block in the shaders
+      struct FrameData {
+        glm::mat4 viewMatrix;
+        glm::mat4 projectionMatrix;
+        glm::mat4 viewProjectionMatrix;
+        glm::vec4 ambientLight;
+        glm::vec4 cameraPos;
+        float farPlane;
+        int lightCount;
+        float padding[2];
+      };
+
+      //Per-draw data, indexed by each model's drawIndex, the normal matrix is padded to a mat4
+      struct DrawData {
+        glm::mat4 modelMatrix;
+        glm::mat4 normalMatrix;
+      };
+
+      GLuint frameDataBufferId = 0;
+      GLuint drawDataBufferId = 0;
+      unsigned int drawDataCapacity = 0;
+      std::vector<DrawData> drawData;
+
+      //Models drawn this frame, resolved from their handles once per frame
+      struct EmitterDraw {
+        ammonite::models::ModelInfo* modelPtr;
+        int lightIndex;
+      };
+
+      std::vector<ammonite::models::ModelInfo*> frameModels;
+      std::vector<EmitterDraw> frameEmitters;
+
       GLuint skyboxVertexArrayId;
 
       GLuint depthCubeMapId = 0;
@@ -79,15 +132,33 @@ namespace ammonite {
       glm::mat4* viewMatrix = ammonite::camera::matrices::getViewMatrixPtr();
       glm::mat4* projectionMatrix = ammonite::camera::matrices::getProjectionMatrixPtr();
 
-      //Get the light trackers
+      //Get the light tracker
       std::map<int, ammonite::lighting::LightSource>* lightTrackerMap = ammonite::lighting::getLightTracker();
-      std::map<int, glm::mat4[6]>* lightTransformMap = ammonite::lighting::getLightTransforms();
       unsigned int maxLightCount = 0;
 
       //View projection combined matrix
       glm::mat4 viewProjectionMatrix;
     }
 
+    namespace {
+      //Largest error a level of detail can project onto the screen, in pixels
+      const float LOD_PIXEL_ERROR = 1.0f;
+      //How far past the threshold the error must move before switching levels
+      const float LOD_HYSTERESIS = 0.25f;
+
+      //First texture unit used by model texture pools
+      const GLuint TEXTURE_POOL_UNIT = 3;
+
+      //Scenes with up to this many lights use a model shader with the light count fixed
+      const int MAX_FIXED_LIGHTS = 4;
+
+      //Number of models each thread composes matrices for
+      const int DRAWS_PER_THREAD = 1024;
+
+      //No material has this index, so the next material index is always sent
+      const GLuint UNSENT_MATERIAL = ~GLuint(0);
+    }
+
     namespace {
       //Check for essential GPU capabilities
       static bool checkGPUCapabilities(int* failureCount) {
@@ -113,6 +184,13 @@ namespace ammonite {
           (*failureCount)++;
         }
 
+        //Check image copies are supported, for texture pools
+        if (!ammonite::utils::checkExtension("GL_ARB_copy_image", "GL_VERSION_4_3")) {
+          std::cerr << ammonite::utils::error << "Image copies unsupported" << std::endl;
+          success = false;
+          (*failureCount)++;
+        }
+
         //Check cubemap arrays are supported
         if (!ammonite::utils::checkExtension("GL_ARB_texture_cube_map_array", "GL_VERSION_4_0")) {
           std::cerr << ammonite::utils::error << "Cubemap arrays unsupported" << std::endl;
@@ -129,6 +207,93 @@ namespace ammonite {
 
         return success;
       }
+
+      static int getModelVariantKey(bool isUntextured, int fixedLightCount) {
+        return ((fixedLightCount + 1) * 2) + (isUntextured ? 1 : 0);
+      }
+
+      //Find uniform locations and set texture units for a model shader variant
+      static void setupModelShader(ModelShader* shader) {
+        GLuint shaderId = shader->shaderId;
+        shader->drawIndexId = glGetUniformLocation(shaderId, "drawIndex");
+        shader->texturePoolsId = glGetUniformLocation(shaderId, "texturePools");
+        shader->materialIndexId = glGetUniformLocation(shaderId, "materialIndex");
+        shader->shadowCubeMapId = glGetUniformLocation(shaderId, "shadowCubeMap");
+
+        //Pass texture unit locations, texture pools use consecutive units, after the skybox
+        glProgramUniform1i(shaderId, shader->shadowCubeMapId, 1);
+        GLint texturePoolUnits[ammonite::textures::MAX_TEXTURE_POOLS];
+        for (int i = 0; i < ammonite::textures::MAX_TEXTURE_POOLS; i++) {
+          texturePoolUnits[i] = TEXTURE_POOL_UNIT + i;
+        }
+        glProgramUniform1iv(shaderId, shader->texturePoolsId, ammonite::textures::MAX_TEXTURE_POOLS, texturePoolUnits);
+      }
+
+      //Submit a model shader variant, it's finished by getModelShader() once the driver is done
+      static void submitModelShader(bool isUntextured, int fixedLightCount) {
+        std::vector<std::string> defineStrings;
+        if (isUntextured) {
+          defineStrings.push_back("UNTEXTURED");
+        }
+        if (fixedLightCount >= 0) {
+          defineStrings.push_back(std::string("LIGHT_COUNT ") + std::to_string(fixedLightCount));
+        }
+
+        std::vector<const char*> defines;
+        for (unsigned int i = 0; i < defineStrings.size(); i++) {
+          defines.push_back(defineStrings[i].c_str());
+        }
+
+        bool hasCreatedShader = true;
+        GLuint programId = ammonite::shaders::loadDirectoryAsync(modelShaderPath.c_str(), defines.data(),
+                                                                 defines.size(), &hasCreatedShader);
+        int variantKey = getModelVariantKey(isUntextured, fixedLightCount);
+        if (hasCreatedShader) {
+          pendingModelShaderVariants[variantKey] = programId;
+        } else {
+          std::cerr << ammonite::utils::warning << "Failed to create model shader variant, using general shader" << std::endl;
+          modelShaderVariants[variantKey] = modelShaderVariants[getModelVariantKey(false, -1)];
+        }
+      }
+
+      /*
+       - Return the model shader variant for a scene and material
+       - Variants are submitted the first time they're needed, the general shader is used until they've compiled
+         - This avoids compiling variants for light counts and materials a scene never uses
+       - If a variant fails to build, the general shader is used in its place
+      */
+      static ModelShader* getModelShader(bool isUntextured, int fixedLightCount) {
+        ModelShader* generalShader = &modelShaderVariants[getModelVariantKey(false, -1)];
+        int variantKey = getModelVariantKey(isUntextured, fixedLightCount);
+        auto variantIt = modelShaderVariants.find(variantKey);
+        if (variantIt != modelShaderVariants.end()) {
+          return &variantIt->second;
+        }
+
+        //Don't wait for the driver during a frame
+        auto pendingIt = pendingModelShaderVariants.find(variantKey);
+        if (pendingIt == pendingModelShaderVariants.end()) {
+          submitModelShader(isUntextured, fixedLightCount);
+          return generalShader;
+        } else if (!ammonite::shaders::isProgramReady(pendingIt->second)) {
+          return generalShader;
+        }
+
+        bool hasCreatedShader = true;
+        ModelShader shader;
+        shader.shaderId = ammonite::shaders::finishProgram(pendingIt->second, &hasCreatedShader);
+        pendingModelShaderVariants.erase(pendingIt);
+        if (hasCreatedShader) {
+          setupModelShader(&shader);
+          ammoniteInternalDebug << "Created model shader variant " << variantKey << std::endl;
+        } else {
+          std::cerr << ammonite::utils::warning << "Failed to create model shader variant, using general shader" << std::endl;
+          shader = *generalShader;
+        }
+
+        modelShaderVariants[variantKey] = shader;
+        return &modelShaderVariants[variantKey];
+      }
     }
 
     namespace setup {
@@ -144,56 +309,55 @@ namespace ammonite {
         //Set window to be used
         window = targetWindow;
 
-        //Create shaders
+        //Submit every shader before waiting for any, so the driver can compile them in parallel
         bool hasCreatedShaders = true;
-        std::string shaderLocation = std::string(shaderPath) + std::string("models/");
-        modelShader.shaderId = ammonite::shaders::loadDirectory(shaderLocation.c_str(), &hasCreatedShaders);
-
-        shaderLocation = std::string(shaderPath) + std::string("lights/");
-        lightShader.shaderId = ammonite::shaders::loadDirectory(shaderLocation.c_str(), &hasCreatedShaders);
-
-        shaderLocation = std::string(shaderPath) + std::string("depth/");
-        depthShader.shaderId = ammonite::shaders::loadDirectory(shaderLocation.c_str(), &hasCreatedShaders);
+        const char* shaderDirectories[4] = {"models/", "lights/", "depth/", "skybox/"};
+        ModelShader generalShader;
+        GLuint* programIds[4] = {&generalShader.shaderId, &lightShader.shaderId,
+                                 &depthShader.shaderId, &skyboxShader.shaderId};
+        for (int i = 0; i < 4; i++) {
+          std::string shaderLocation = std::string(shaderPath) + std::string(shaderDirectories[i]);
+          *programIds[i] = ammonite::shaders::loadDirectoryAsync(shaderLocation.c_str(), &hasCreatedShaders);
+        }
 
-        shaderLocation = std::string(shaderPath) + std::string("skybox/");
-        skyboxShader.shaderId = ammonite::shaders::loadDirectory(shaderLocation.c_str(), &hasCreatedShaders);
+        //Wait for and check each program
+        for (int i = 0; i < 4; i++) {
+          *programIds[i] = ammonite::shaders::finishProgram(*programIds[i], &hasCreatedShaders);
+        }
 
         if (!hasCreatedShaders) {
           *externalSuccess = false;
           return;
         }
 
+        //Keep the general model shader, specialised variants are submitted once a frame needs them
+        modelShaderPath = std::string(shaderPath) + std::string("models/");
+        setupModelShader(&generalShader);
+        modelShaderVariants[getModelVariantKey(false, -1)] = generalShader;
+
         //Shader uniform locations
-        modelShader.matrixId = glGetUniformLocation(modelShader.shaderId, "MVP");
-        modelShader.modelMatrixId = glGetUniformLocation(modelShader.shaderId, "modelMatrix");
-        modelShader.normalMatrixId = glGetUniformLocation(modelShader.shaderId, "normalMatrix");
-        modelShader.ambientLightId = glGetUniformLocation(modelShader.shaderId, "ambientLight");
-        modelShader.cameraPosId = glGetUniformLocation(modelShader.shaderId, "cameraPos");
-        modelShader.farPlaneId = glGetUniformLocation(modelShader.shaderId, "farPlane");
-        modelShader.lightCountId = glGetUniformLocation(modelShader.shaderId, "lightCount");
-        modelShader.textureSamplerId = glGetUniformLocation(modelShader.shaderId, "textureSampler");
-        modelShader.shadowCubeMapId = glGetUniformLocation(modelShader.shaderId, "shadowCubeMap");
-
-        lightShader.lightMatrixId = glGetUniformLocation(lightShader.shaderId, "MVP");
+
+        lightShader.drawIndexId = glGetUniformLocation(lightShader.shaderId, "drawIndex");
         lightShader.lightIndexId = glGetUniformLocation(lightShader.shaderId, "lightIndex");
 
-        depthShader.modelMatrixId = glGetUniformLocation(depthShader.shaderId, "modelMatrix");
-        depthShader.farPlaneId = glGetUniformLocation(depthShader.shaderId, "farPlane");
+        depthShader.drawIndexId = glGetUniformLocation(depthShader.shaderId, "drawIndex");
         depthShader.depthLightPosId = glGetUniformLocation(depthShader.shaderId, "lightPos");
         depthShader.depthShadowIndex = glGetUniformLocation(depthShader.shaderId, "shadowMapIndex");
 
-        skyboxShader.viewMatrixId = glGetUniformLocation(skyboxShader.shaderId, "viewMatrix");
-        skyboxShader.projectionMatrixId = glGetUniformLocation(skyboxShader.shaderId, "projectionMatrix");
         skyboxShader.skyboxSamplerId = glGetUniformLocation(skyboxShader.shaderId, "skyboxSampler");
 
         //Pass texture unit locations
-        glUseProgram(modelShader.shaderId);
-        glUniform1i(modelShader.textureSamplerId, 0);
-        glUniform1i(modelShader.shadowCubeMapId, 1);
-
         glUseProgram(skyboxShader.shaderId);
         glUniform1i(skyboxShader.skyboxSamplerId, 2);
 
+        //Prepare timer queries for each pass
+        ammonite::gpuTiming::setupGpuTiming();
+
+        //Create the frame constants buffer, shared by every program
+        glCreateBuffers(1, &frameDataBufferId);
+        glNamedBufferData(frameDataBufferId, sizeof(FrameData), nullptr, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, 0, frameDataBufferId);
+
         //Setup depth map framebuffer
         glCreateFramebuffers(1, &depthMapFBO);
         glNamedFramebufferDrawBuffer(depthMapFBO, GL_NONE);
@@ -257,12 +421,18 @@ namespace ammonite {
         }
       }
 
-      static void drawModel(ammonite::models::ModelInfo *drawObject, int lightIndex, bool depthPass) {
+      static void drawModel(ammonite::models::ModelInfo *drawObject, int lightIndex, bool depthPass,
+                            MaterialFilter materialFilter) {
         //If the model is disabled, skip it
         if (!drawObject->isActive or !drawObject->isLoaded) {
           return;
         }
 
+        //Skip models that were evicted and couldn't be restored before drawing
+        if (!drawObject->modelData->isResident) {
+          return;
+        }
+
         //Get model draw data
         ammonite::models::ModelData* drawObjectData = drawObject->modelData;
 
@@ -279,38 +449,60 @@ namespace ammonite {
           setWireframe(false);
         }
 
-        //Calculate and obtain matrices
-        glm::mat4 modelMatrix = drawObject->positionData.modelMatrix;
-
-        //Calculate the MVP matrix for shading and light emitter passes
-        glm::mat4 mvp;
-        if (!depthPass) {
-          mvp = viewProjectionMatrix * modelMatrix;
-        }
-
-        //Send uniforms to the shaders
+        //Send the model's index into the draw buffer, the regular pass sends it with the first mesh drawn
         if (depthPass) { //Depth pass
-          glUniformMatrix4fv(depthShader.modelMatrixId, 1, GL_FALSE, &modelMatrix[0][0]);
-        } else if (lightIndex == -1) { //Regular pass
-          glUniformMatrix4fv(modelShader.matrixId, 1, GL_FALSE, &mvp[0][0]);
-          glUniformMatrix4fv(modelShader.modelMatrixId, 1, GL_FALSE, &modelMatrix[0][0]);
-          glUniformMatrix3fv(modelShader.normalMatrixId, 1, GL_FALSE, &drawObject->positionData.normalMatrix[0][0]);
-        } else { //Light emitter pass
-          glUniformMatrix4fv(lightShader.lightMatrixId, 1, GL_FALSE, &mvp[0][0]);
+          glUniform1ui(depthShader.drawIndexId, drawObject->drawIndex);
+        } else if (lightIndex != -1) { //Light emitter pass
+          glUniform1ui(lightShader.drawIndexId, drawObject->drawIndex);
           glUniform1i(lightShader.lightIndexId, lightIndex);
         }
 
+        bool hasSentIndex = false;
         for (unsigned int i = 0; i < drawObjectData->meshes.size(); i++) {
-          //Set texture for regular shading pass
+          ammonite::models::MeshData* meshData = &drawObjectData->meshes[i];
+
+          //Use the selected level of detail, or the simplest one the mesh has
+          int lodLevel = std::min(drawObject->lodLevel, int(meshData->lodLevels.size()) - 1);
+          ammonite::models::LodLevel* lod = &meshData->lodLevels[lodLevel];
+          int indexSize = (meshData->indexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+
+          //Select the material for regular shading pass, textures are already bound
           if (lightIndex == -1 and !depthPass) {
-            glBindTextureUnit(0, drawObject->textureIds[i]);
+            GLuint materialIndex = drawObject->textureOverride;
+            if (materialIndex == 0) {
+              materialIndex = drawObjectData->textureIds[i];
+            }
+
+            //Untextured meshes use a cheaper variant, drawn by their own sub-pass
+            bool isUntextured = (materialIndex == 0);
+            hasUntexturedMeshes = hasUntexturedMeshes or isUntextured;
+            if ((isUntextured and materialFilter == TEXTURED_MATERIALS) or
+                (!isUntextured and materialFilter == UNTEXTURED_MATERIALS)) {
+              continue;
+            }
+
+            if (!hasSentIndex) {
+              glUniform1ui(modelShader->drawIndexId, drawObject->drawIndex);
+              hasSentIndex = true;
+            }
+
+            //Copies of a model share materials, so only send the index when it changes
+            if (materialIndex != sentMaterialIndex) {
+              glUniform1ui(modelShader->materialIndexId, materialIndex);
+              sentMaterialIndex = materialIndex;
+            }
           }
 
           //Bind vertex attribute buffer
-          glBindVertexArray(drawObjectData->meshes[i].vertexArrayId);
+          glBindVertexArray(meshData->vertexArrayId);
 
-          //Draw the triangles
-          glDrawElements(mode, drawObjectData->meshes[i].vertexCount, GL_UNSIGNED_INT, nullptr);
+          //Draw the triangles, once for each node using the mesh
+          int instanceCount = std::max(int(meshData->instanceTransforms.size()), 1);
+          glDrawElementsInstanced(mode, lod->indexCount, meshData->indexType,
+                                  (void*)(std::size_t(lod->indexOffset) * indexSize), instanceCount);
+
+          //The depth pass' geometry shader draws each triangle to all 6 cubemap faces
+          ammonite::renderStats::countDraw(mode, lod->indexCount, instanceCount, depthPass ? 6 : 1);
         }
       }
     }
@@ -323,23 +515,227 @@ namespace ammonite {
       return frameTime;
     }
 
-    static void drawModels(const int modelIds[], const int modelCount, bool depthPass) {
-      //Draw given models
-      for (int i = 0; i < modelCount; i++) {
-        ammonite::models::ModelInfo* modelPtr = ammonite::models::getModelPtr(modelIds[i]);
-        //Only draw non-light emitting models that exist
-        if (modelPtr != nullptr) {
-          if (!modelPtr->isLightEmitting) {
-            drawModel(modelPtr, -1, depthPass);
+    //Distribution of frame times since the last reset
+    void getFrameStats(FrameStats* stats) {
+      ammonite::frameStats::getFrameStats(stats);
+    }
+
+    void resetFrameStats() {
+      ammonite::frameStats::resetFrameStats();
+    }
+
+    //Count frames slower than each threshold, in seconds
+    void setFrameTimeThresholds(const double thresholds[], int thresholdCount) {
+      ammonite::frameStats::setThresholds(thresholds, thresholdCount);
+    }
+
+    //Counts from the last complete frame
+    void getRenderStats(RenderStats* stats) {
+      ammonite::renderStats::getRenderStats(stats);
+    }
+
+    //Copy the last headless frame into pixels, as width * height RGBA bytes from the bottom row up
+    bool readFramePixels(unsigned char pixels[]) {
+      if (!ammonite::headless::readPixels(pixels)) {
+        std::cerr << ammonite::utils::warning << "Frames can only be read back in headless mode" << std::endl;
+        return false;
+      }
+
+      return true;
+    }
+
+    /*
+     - Jitter is how far the time between frame starts strays from the frame period, in seconds
+     - Lateness is how far missed deadlines were missed by, on average, in seconds
+     - CPU usage is the process' CPU time over wall time, everything is since the last reset
+    */
+    void getPacingStats(double* meanJitter, double* maxJitter, long* missedDeadlines,
+                        double* meanLateness, double* cpuUsage) {
+      ammonite::pacing::getPacingStats(meanJitter, maxJitter, missedDeadlines, meanLateness, cpuUsage);
+    }
+
+    void resetPacingStats() {
+      ammonite::pacing::resetPacingStats();
+    }
+
+    //Rolling average GPU time of each pass, in seconds, results lag a few frames behind
+    void getGpuPassTimes(double* shadowTime, double* modelTime, double* emitterTime, double* skyboxTime) {
+      *shadowTime = ammonite::gpuTiming::getPassTime(ammonite::gpuTiming::SHADOW_PASS);
+      *modelTime = ammonite::gpuTiming::getPassTime(ammonite::gpuTiming::MODEL_PASS);
+      *emitterTime = ammonite::gpuTiming::getPassTime(ammonite::gpuTiming::EMITTER_PASS);
+      *skyboxTime = ammonite::gpuTiming::getPassTime(ammonite::gpuTiming::SKYBOX_PASS);
+    }
+
+    //Mean GPU time of each pass, in seconds, over the frames read back since the last reset
+    void getMeanGpuPassTimes(double* shadowTime, double* modelTime, double* emitterTime, double* skyboxTime) {
+      double meanTimes[ammonite::gpuTiming::PASS_COUNT];
+      ammonite::gpuTiming::getMeanPassTimes(meanTimes);
+      *shadowTime = meanTimes[ammonite::gpuTiming::SHADOW_PASS];
+      *modelTime = meanTimes[ammonite::gpuTiming::MODEL_PASS];
+      *emitterTime = meanTimes[ammonite::gpuTiming::EMITTER_PASS];
+      *skyboxTime = meanTimes[ammonite::gpuTiming::SKYBOX_PASS];
+    }
+
+    //Clear the rolling and mean GPU times, so earlier frames don't affect them
+    void resetGpuTimes() {
+      ammonite::gpuTiming::resetTimes();
+    }
+
+    //Per light shadow times, only recorded while light timing is enabled in the settings
+    int getGpuLightTimes(double lightTimes[], int maxLightCount) {
+      return ammonite::gpuTiming::getLightTimes(lightTimes, maxLightCount);
+    }
+
+    namespace {
+      //Find the simplest level whose error stays under the threshold
+      static int findLodLevel(std::vector<float>* lodErrors, float errorScale, float threshold) {
+        int lodLevel = 0;
+        for (unsigned int i = 1; i < lodErrors->size(); i++) {
+          if ((*lodErrors)[i] * errorScale > threshold) {
+            break;
           }
+          lodLevel = i;
         }
+
+        return lodLevel;
+      }
+
+      //Pick a level of detail for each model, from its projected error
+      static void selectLods() {
+        ammoniteProfileZone("selectLods");
+        static int* heightPtr = ammonite::settings::runtime::internal::getHeightPtr();
+        static float* lodBiasPtr = ammonite::settings::graphics::internal::getLodBiasPtr();
+
+        //Convert model space error to pixels at a distance of 1
+        const float pixelScale = (*projectionMatrix)[1][1] * float(*heightPtr) / 2.0f;
+        const float threshold = LOD_PIXEL_ERROR * std::pow(2.0f, *lodBiasPtr);
+        glm::vec3 cameraPosition = ammonite::camera::getPosition(ammonite::camera::getActiveCamera());
+
+        for (unsigned int i = 0; i < frameModels.size(); i++) {
+          ammonite::models::ModelInfo* modelPtr = frameModels[i];
+          ammonite::models::ModelData* modelData = modelPtr->modelData;
+          if (modelData->lodErrors.size() <= 1) {
+            modelPtr->lodLevel = 0;
+            continue;
+          }
+
+          //Measure from the nearest point of the bounding sphere, scaled by the largest axis
+          glm::mat4* modelMatrix = &modelPtr->positionData.modelMatrix;
+          glm::vec3 centre = glm::vec3(*modelMatrix * glm::vec4(modelData->boundsCentre, 1.0f));
+          float scale = std::max(glm::length(glm::vec3((*modelMatrix)[0])),
+                                 std::max(glm::length(glm::vec3((*modelMatrix)[1])),
+                                          glm::length(glm::vec3((*modelMatrix)[2]))));
+          float distance = glm::length(centre - cameraPosition) - modelData->boundsRadius * scale;
+          if (distance <= 0.0f) {
+            modelPtr->lodLevel = 0;
+            continue;
+          }
+
+          //Only move to a simpler level once it's clearly allowed, and back once clearly needed
+          float errorScale = scale * pixelScale / distance;
+          int minLevel = findLodLevel(&modelData->lodErrors, errorScale, threshold * (1.0f - LOD_HYSTERESIS));
+          int maxLevel = findLodLevel(&modelData->lodErrors, errorScale, threshold * (1.0f + LOD_HYSTERESIS));
+          modelPtr->lodLevel = std::clamp(modelPtr->lodLevel, minLevel, maxLevel);
+        }
+      }
+
+      //Write a model's matrices to its slot in the draw buffer, composing them if they changed
+      static void writeDrawData(ammonite::models::ModelInfo* modelPtr, unsigned int drawIndex) {
+        ammonite::models::updateModelMatrices(&modelPtr->positionData);
+        drawData[drawIndex] = {modelPtr->positionData.modelMatrix,
+                               glm::mat4(modelPtr->positionData.normalMatrix)};
+      }
+
+      //Compose and upload the matrices of every model drawn this frame, growing the buffer if needed
+      static void uploadDrawData() {
+        ammoniteProfileZone("uploadDrawData");
+        const int modelCount = frameModels.size();
+        drawData.resize(modelCount + frameEmitters.size());
+
+        //Assign slots first, so a model passed more than once is only composed by one thread
+        for (int i = 0; i < modelCount; i++) {
+          frameModels[i]->drawIndex = i;
+        }
+
+        //Use 1 thread per batch of models, up to the OpenMP limit
+        int threadCount = std::min(modelCount / DRAWS_PER_THREAD + 1, omp_get_max_threads());
+        threadCount = std::max(threadCount, 1);
+
+        #pragma omp parallel for schedule(static) num_threads(threadCount)
+        for (int i = 0; i < modelCount; i++) {
+          if (frameModels[i]->drawIndex == i) {
+            writeDrawData(frameModels[i], i);
+          }
+        }
+
+        //Emitters are few, and are usually already composed as part of frameModels
+        for (unsigned int i = 0; i < frameEmitters.size(); i++) {
+          frameEmitters[i].modelPtr->drawIndex = modelCount + i;
+          writeDrawData(frameEmitters[i].modelPtr, modelCount + i);
+        }
+
+        if (drawData.empty()) {
+          return;
+        }
+
+        if (drawData.size() > drawDataCapacity) {
+          if (drawDataBufferId != 0) {
+            glDeleteBuffers(1, &drawDataBufferId);
+          }
+
+          //Recreate the buffer with spare space
+          drawDataCapacity = std::max((unsigned int)drawData.size(), drawDataCapacity * 2);
+          glCreateBuffers(1, &drawDataBufferId);
+          glNamedBufferData(drawDataBufferId, drawDataCapacity * sizeof(DrawData), nullptr, GL_DYNAMIC_DRAW);
+          glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, drawDataBufferId);
+        }
+
+        glNamedBufferSubData(drawDataBufferId, 0, drawData.size() * sizeof(DrawData), &drawData[0]);
+        ammonite::renderStats::countBufferUpload(drawData.size() * sizeof(DrawData));
+      }
+    }
+
+    static void drawModels(bool depthPass, MaterialFilter materialFilter) {
+      //Draw this frame's models, light emitting models are drawn separately
+      for (unsigned int i = 0; i < frameModels.size(); i++) {
+        if (!frameModels[i]->isLightEmitting) {
+          drawModel(frameModels[i], -1, depthPass, materialFilter);
+        }
+      }
+    }
+
+    /*
+     - Draw the model pass, grouped by shader variant so each program is bound at most once
+     - If both variants are the same program, every mesh is drawn in one sub-pass
+    */
+    static void drawModelPass() {
+      ammoniteProfileZone("Model pass");
+      bool splitVariants = (sceneShaders[0] != sceneShaders[1]);
+      hasUntexturedMeshes = false;
+      drawModels(false, splitVariants ? TEXTURED_MATERIALS : ALL_MATERIALS);
+
+      //Only swap to the untextured variant if the first sub-pass skipped any meshes
+      if (splitVariants and hasUntexturedMeshes) {
+        modelShader = sceneShaders[1];
+        sentMaterialIndex = UNSENT_MATERIAL;
+        glUseProgram(modelShader->shaderId);
+        ammonite::renderStats::countProgramSwitch();
+        drawModels(false, UNTEXTURED_MATERIALS);
       }
     }
 
     void drawFrame(const int modelIds[], const int modelCount) {
+      ammoniteProfileZone("drawFrame");
       //Increase frame counters
       totalFrames++;
       frameCount++;
+      ammonite::frameStats::recordFrame();
+
+      //Evict data that hasn't been drawn recently, if over the memory budget
+      ammonite::residency::enforceBudget(totalFrames);
+
+      //Read back GPU times from a few frames ago, and reuse their queries
+      ammonite::gpuTiming::beginFrame();
 
       //Every tenth of a second, update the frame time
       static ammonite::utils::Timer frameTimer;
@@ -387,20 +783,64 @@ namespace ammonite {
         lastLightCount = lightCount;
       }
 
+      //Get information about light sources to be rendered
+      int lightEmitterCount;
+      std::vector<int> lightData;
+      ammonite::lighting::getLightEmitters(&lightEmitterCount, &lightData);
+
+      //Resolve the handles once, every pass then walks the drawable models directly
+      ammonite::models::getDrawableModels(modelIds, modelCount, &frameModels);
+      frameEmitters.clear();
+      for (int i = 0; i < lightEmitterCount; i++) {
+        ammonite::models::ModelInfo* modelPtr = ammonite::models::getModelPtr(lightData[i * 2]);
+        if (modelPtr != nullptr and modelPtr->isActive and modelPtr->isLoaded) {
+          frameEmitters.push_back({modelPtr, lightData[(i * 2) + 1]});
+        }
+      }
+
+      //Restore evicted models now, as reloading textures can replace the bound pools
+      for (unsigned int i = 0; i < frameModels.size(); i++) {
+        ammonite::models::markModelUsed(frameModels[i]);
+      }
+
+      for (unsigned int i = 0; i < frameEmitters.size(); i++) {
+        ammonite::models::markModelUsed(frameEmitters[i].modelPtr);
+      }
+
+      //Upload the matrices of every model once, each draw only sends its index
+      uploadDrawData();
+
+      //Select levels of detail once, so every pass draws the same geometry
+      selectLods();
+
+      //Calculate view projection matrix
+      viewProjectionMatrix = *projectionMatrix * *viewMatrix;
+
+      //Upload constants shared by every program for this frame
+      static float* farPlanePtr = ammonite::settings::graphics::internal::getShadowFarPlanePtr();
+      unsigned int activeLights = std::min(lightCount, maxLightCount);
+      FrameData frameData;
+      frameData.viewMatrix = *viewMatrix;
+      frameData.projectionMatrix = *projectionMatrix;
+      frameData.viewProjectionMatrix = viewProjectionMatrix;
+      frameData.ambientLight = glm::vec4(ammonite::lighting::getAmbientLight(), 0.0f);
+      frameData.cameraPos = glm::vec4(ammonite::camera::getPosition(ammonite::camera::getActiveCamera()), 1.0f);
+      frameData.farPlane = *farPlanePtr;
+      frameData.lightCount = activeLights;
+      glNamedBufferSubData(frameDataBufferId, 0, sizeof(FrameData), &frameData);
+      ammonite::renderStats::countBufferUpload(sizeof(FrameData));
+
       //Swap to depth shader
       glUseProgram(depthShader.shaderId);
+      ammonite::renderStats::countProgramSwitch();
       glViewport(0, 0, *shadowResPtr, *shadowResPtr);
       glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
 
-      //Pass uniforms that don't change between light source
-      static float* farPlanePtr = ammonite::settings::graphics::internal::getShadowFarPlanePtr();
-      glUniform1f(depthShader.farPlaneId, *farPlanePtr);
-
       //Clear existing depths values
+      ammonite::gpuTiming::beginPass(ammonite::gpuTiming::SHADOW_PASS);
       glClear(GL_DEPTH_BUFFER_BIT);
 
       auto lightIt = lightTrackerMap->begin();
-      unsigned int activeLights = std::min(lightCount, maxLightCount);
       for (unsigned int shadowCount = 0; shadowCount < activeLights; shadowCount++) {
         //Get light source and position from tracker
         auto lightSource = &lightIt->second;
@@ -411,24 +851,21 @@ namespace ammonite {
           std::cerr << ammonite::utils::warning << "Warning: Incomplete depth framebuffer" << std::endl;
         }
 
-        //Pass shadow transform matrices to depth shader
-        for (int i = 0; i < 6; i++) {
-          GLuint shadowMatrixId = glGetUniformLocation(depthShader.shaderId, std::string("shadowMatrices[" + std::to_string(i) + "]").c_str());
-          //Fetch the transform from the tracker, and send to the shader
-          glUniformMatrix4fv(shadowMatrixId, 1, GL_FALSE, &((*lightTransformMap)[lightSource->lightId][i])[0][0]);
-        }
-
-        //Pass light source specific uniforms
+        //Pass light source specific uniforms, shadow transforms are read from the light manager's buffer
         glUniform3fv(depthShader.depthLightPosId, 1, &lightPos[0]);
         glUniform1i(depthShader.depthShadowIndex, shadowCount);
 
         //Render to depth buffer and move to the next light source
-        drawModels(modelIds, modelCount, true);
+        ammonite::gpuTiming::beginLight(shadowCount);
+        ammoniteProfileZone("Depth pass");
+        drawModels(true, ALL_MATERIALS);
+        ammonite::gpuTiming::endLight(shadowCount);
         std::advance(lightIt, 1);
       }
+      ammonite::gpuTiming::endPass(ammonite::gpuTiming::SHADOW_PASS);
 
       //Reset the framebuffer and viewport
-      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      glBindFramebuffer(GL_FRAMEBUFFER, ammonite::headless::getFramebufferId());
       static int* widthPtr = ammonite::settings::runtime::internal::getWidthPtr();
       static int* heightPtr = ammonite::settings::runtime::internal::getHeightPtr();
       glViewport(0, 0, *widthPtr, *heightPtr);
@@ -441,9 +878,20 @@ namespace ammonite {
         glClear(GL_DEPTH_BUFFER_BIT);
       }
 
-      //Prepare model shader and depth cube map
-      glUseProgram(modelShader.shaderId);
+      //Pick the model shader variants for this scene, fixing the light count when it's small
+      //The untextured variant is only requested once a frame has drawn untextured meshes
+      int fixedLightCount = (int(activeLights) <= MAX_FIXED_LIGHTS) ? int(activeLights) : -1;
+      sceneShaders[0] = getModelShader(false, fixedLightCount);
+      sceneShaders[1] = hasUntexturedMeshes ? getModelShader(true, fixedLightCount) : sceneShaders[0];
+
+      //Prepare model shader, depth cube map and texture pools
+      modelShader = sceneShaders[0];
+      sentMaterialIndex = UNSENT_MATERIAL;
+      glUseProgram(modelShader->shaderId);
       glBindTextureUnit(1, depthCubeMapId);
+      ammonite::renderStats::countProgramSwitch();
+      ammonite::renderStats::countTextureBind();
+      ammonite::textures::bindTexturePools(TEXTURE_POOL_UNIT);
 
       //Use gamma correction if enabled
       static bool* gammaPtr = ammonite::settings::graphics::internal::getGammaCorrectionPtr();
@@ -451,83 +899,62 @@ namespace ammonite {
         glEnable(GL_FRAMEBUFFER_SRGB);
       }
 
-      //Calculate view projection matrix
-      viewProjectionMatrix = *projectionMatrix * *viewMatrix;
-
-      //Get ambient light and camera position
-      glm::vec3 ambientLight = ammonite::lighting::getAmbientLight();
-      glm::vec3 cameraPosition = ammonite::camera::getPosition(ammonite::camera::getActiveCamera());
-
-      //Pass uniforms and render regular models
-      glUniform3fv(modelShader.ambientLightId, 1, &ambientLight[0]);
-      glUniform3fv(modelShader.cameraPosId, 1, &cameraPosition[0]);
-      glUniform1f(modelShader.farPlaneId, *farPlanePtr);
-      glUniform1i(modelShader.lightCountId, activeLights);
-      drawModels(modelIds, modelCount, false);
-
-      //Get information about light sources to be rendered
-      int lightEmitterCount;
-      std::vector<int> lightData;
-      ammonite::lighting::getLightEmitters(&lightEmitterCount, &lightData);
+      //Render regular models
+      ammonite::gpuTiming::beginPass(ammonite::gpuTiming::MODEL_PASS);
+      drawModelPass();
+      ammonite::gpuTiming::endPass(ammonite::gpuTiming::MODEL_PASS);
 
       //Swap to the light emitting model shader
-      if (lightEmitterCount > 0) {
+      if (!frameEmitters.empty()) {
+        ammoniteProfileZone("Light emitter pass");
+        ammonite::gpuTiming::beginPass(ammonite::gpuTiming::EMITTER_PASS);
         glUseProgram(lightShader.shaderId);
+        ammonite::renderStats::countProgramSwitch();
 
         //Draw light sources with models attached
-        for (int i = 0; i < lightEmitterCount; i++) {
-          int modelId = lightData[(i * 2)];
-          int lightIndex = lightData[(i * 2) + 1];
-          ammonite::models::ModelInfo* modelPtr = ammonite::models::getModelPtr(modelId);
-
-          if (modelPtr != nullptr) {
-            drawModel(modelPtr, lightIndex, false);
-          }
+        for (unsigned int i = 0; i < frameEmitters.size(); i++) {
+          drawModel(frameEmitters[i].modelPtr, frameEmitters[i].lightIndex, false, ALL_MATERIALS);
         }
+        ammonite::gpuTiming::endPass(ammonite::gpuTiming::EMITTER_PASS);
       }
 
       //Draw the skybox
       if (activeSkybox != 0) {
-        //Swap to skybox shader and pass uniforms
+        ammoniteProfileZone("Skybox pass");
+        ammonite::gpuTiming::beginPass(ammonite::gpuTiming::SKYBOX_PASS);
+        //Swap to skybox shader, matrices come from the frame constants
         glUseProgram(skyboxShader.shaderId);
-        glUniformMatrix4fv(skyboxShader.viewMatrixId, 1, GL_FALSE, &(glm::mat4(glm::mat3(*viewMatrix)))[0][0]);
-        glUniformMatrix4fv(skyboxShader.projectionMatrixId, 1, GL_FALSE, &(*projectionMatrix)[0][0]);
+        ammonite::renderStats::countProgramSwitch();
 
         //Prepare and draw the skybox
         setWireframe(false);
         glBindVertexArray(skyboxVertexArrayId);
         glBindTextureUnit(2, activeSkybox);
         glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, nullptr);
+        ammonite::renderStats::countTextureBind();
+        ammonite::renderStats::countDraw(GL_TRIANGLES, 36, 1, 1);
+        ammonite::gpuTiming::endPass(ammonite::gpuTiming::SKYBOX_PASS);
       }
 
       //Disable gamma correction for start of next pass
       glDisable(GL_FRAMEBUFFER_SRGB);
 
-      //Swap buffers
-      glfwSwapBuffers(window);
-
-      //Figure out time budget remaining
-      static ammonite::utils::Timer targetFrameTimer;
+      //Swap buffers, or just submit the frame if it was drawn to the headless framebuffer
+      if (window != nullptr) {
+        glfwSwapBuffers(window);
+      } else {
+        glFlush();
+      }
+      ammonite::renderStats::endFrame();
 
       //Wait until next frame should be prepared
       static float* frameLimitPtr = ammonite::settings::graphics::internal::getFrameLimitPtr();
-      if (*frameLimitPtr != 0.0f) {
-        //Length of microsleep and allowable error
-        static const double sleepInterval = 1.0 / 100000;
-        static const double maxError = (sleepInterval) * 1.1;
-        static const auto sleepLength = std::chrono::nanoseconds(int(std::floor(sleepInterval * 1000000000.0)));
-
-        double const targetFrameTime = 1.0 / *frameLimitPtr;
-        double spareTime = targetFrameTime - targetFrameTimer.getTime();;
-
-        //Sleep for short intervals until the frametime budget is gone
-        while (spareTime > maxError) {
-          std::this_thread::sleep_for(sleepLength);
-          spareTime = targetFrameTime - targetFrameTimer.getTime();
-        }
-      }
+      ammonite::pacing::waitForNextFrame(*frameLimitPtr);
 
-      targetFrameTimer.reset();
+#ifdef PROFILE
+      //Hand the frame's events to a running capture
+      ammonite::utils::profiler::internal::endFrame();
+#endif
     }
   }
 }
@@ -5,12 +5,54 @@
 
 namespace ammonite {
   namespace renderer {
+    const int MAX_FRAME_THRESHOLDS = 8;
+
+    //Frame times are in seconds, onePercentLow is the frame rate of the slowest 1% of frames
+    struct FrameStats {
+      long frameCount = 0;
+      double minTime = 0.0;
+      double meanTime = 0.0;
+      double p50Time = 0.0;
+      double p95Time = 0.0;
+      double p99Time = 0.0;
+      double maxTime = 0.0;
+      double onePercentLow = 0.0;
+
+      int thresholdCount = 0;
+      double thresholds[MAX_FRAME_THRESHOLDS] = {0.0};
+      long framesOverThreshold[MAX_FRAME_THRESHOLDS] = {0};
+    };
+
+    //Work submitted in a frame, uploads include anything loaded since the previous frame
+    struct RenderStats {
+      long drawCalls = 0;
+      long long int indexCount = 0;
+      long long int triangleCount = 0;
+      long textureBinds = 0;
+      long programSwitches = 0;
+      long bufferUploads = 0;
+      long textureUploads = 0;
+      long long int uploadedBytes = 0;
+    };
+
     namespace setup {
       void setupRenderer(GLFWwindow* targetWindow, const char* shaderPath, bool* externalSuccess);
     }
 
     long getTotalFrames();
     double getFrameTime();
+    void getFrameStats(FrameStats* stats);
+    void resetFrameStats();
+    void setFrameTimeThresholds(const double thresholds[], int thresholdCount);
+    void getRenderStats(RenderStats* stats);
+    bool readFramePixels(unsigned char pixels[]);
+    void getPacingStats(double* meanJitter, double* maxJitter, long* missedDeadlines,
+                        double* meanLateness, double* cpuUsage);
+    void resetPacingStats();
+    void getGpuPassTimes(double* shadowTime, double* modelTime, double* emitterTime, double* skyboxTime);
+    int getGpuLightTimes(double lightTimes[], int maxLightCount);
+    void getMeanGpuPassTimes(double* shadowTime, double* modelTime, double* emitterTime, double* skyboxTime);
+    void resetGpuTimes();
 
     void drawFrame(const int modelIds[], const int modelCount);
   }
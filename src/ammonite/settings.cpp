@@ -1,5 +1,7 @@
 #include <GLFW/glfw3.h>
 
+#include "internal/headless.hpp"
+
 #include "internal/internalDebug.hpp"
 
 namespace ammonite {
@@ -92,6 +94,9 @@ namespace ammonite {
           int shadowRes = 1024;
           float farPlane = 25.0f;
           bool gammaCorrection = false;
+          float lodBias = 0.0f;
+          int gpuMemoryBudget = 0;
+          bool lightTiming = false;
         } graphics;
       }
 
@@ -112,10 +117,25 @@ namespace ammonite {
         bool* getGammaCorrectionPtr() {
           return &graphics.gammaCorrection;
         }
+
+        float* getLodBiasPtr() {
+          return &graphics.lodBias;
+        }
+
+        int* getGpuMemoryBudgetPtr() {
+          return &graphics.gpuMemoryBudget;
+        }
+
+        bool* getLightTimingPtr() {
+          return &graphics.lightTiming;
+        }
       }
 
       void setVsync(bool enabled) {
-        glfwSwapInterval(int(enabled));
+        //Headless contexts have nothing to swap
+        if (!ammonite::headless::isHeadless()) {
+          glfwSwapInterval(int(enabled));
+        }
         graphics.vsyncEnabled = enabled;
       }
 
@@ -154,6 +174,125 @@ namespace ammonite {
       bool getGammaCorrection() {
         return graphics.gammaCorrection;
       }
+
+      //Positive values switch to simpler levels of detail sooner, negative values later
+      void setLodBias(float lodBias) {
+        graphics.lodBias = lodBias;
+      }
+
+      float getLodBias() {
+        return graphics.lodBias;
+      }
+
+      //Budget in megabytes for model and texture data, 0 disables eviction
+      void setGpuMemoryBudget(int megabytes) {
+        graphics.gpuMemoryBudget = megabytes;
+      }
+
+      int getGpuMemoryBudget() {
+        return graphics.gpuMemoryBudget;
+      }
+
+      //Time each light's shadow render on the GPU, as well as each pass
+      void setLightTiming(bool lightTiming) {
+        graphics.lightTiming = lightTiming;
+      }
+
+      bool getLightTiming() {
+        return graphics.lightTiming;
+      }
+    }
+
+    namespace models {
+      namespace {
+        struct ModelSettings {
+          bool compactVertices = false;
+          bool optimiseMeshes = true;
+          bool optimiseOverdraw = false;
+          bool generateLods = true;
+          bool retainMeshData = true;
+          bool preserveHierarchy = false;
+        } models;
+      }
+
+      //Exposed internally only
+      namespace internal {
+        bool* getCompactVerticesPtr() {
+          return &models.compactVertices;
+        }
+
+        bool* getOptimiseMeshesPtr() {
+          return &models.optimiseMeshes;
+        }
+
+        bool* getOptimiseOverdrawPtr() {
+          return &models.optimiseOverdraw;
+        }
+
+        bool* getGenerateLodsPtr() {
+          return &models.generateLods;
+        }
+
+        bool* getRetainMeshDataPtr() {
+          return &models.retainMeshData;
+        }
+
+        bool* getPreserveHierarchyPtr() {
+          return &models.preserveHierarchy;
+        }
+      }
+
+      //Model settings only affect models loaded after the setting is changed
+      void setCompactVertices(bool compactVertices) {
+        models.compactVertices = compactVertices;
+      }
+
+      bool getCompactVertices() {
+        return models.compactVertices;
+      }
+
+      void setOptimiseMeshes(bool optimiseMeshes) {
+        models.optimiseMeshes = optimiseMeshes;
+      }
+
+      bool getOptimiseMeshes() {
+        return models.optimiseMeshes;
+      }
+
+      //Overdraw optimisation requires mesh optimisation to be enabled
+      void setOptimiseOverdraw(bool optimiseOverdraw) {
+        models.optimiseOverdraw = optimiseOverdraw;
+      }
+
+      bool getOptimiseOverdraw() {
+        return models.optimiseOverdraw;
+      }
+
+      void setGenerateLods(bool generateLods) {
+        models.generateLods = generateLods;
+      }
+
+      bool getGenerateLods() {
+        return models.generateLods;
+      }
+
+      //Keep a copy of mesh data in system memory after it's uploaded
+      void setRetainMeshData(bool retainMeshData) {
+        models.retainMeshData = retainMeshData;
+      }
+
+      bool getRetainMeshData() {
+        return models.retainMeshData;
+      }
+
+      //Keep node transforms and draw meshes used by several nodes with instancing
+      void setPreserveHierarchy(bool preserveHierarchy) {
+        models.preserveHierarchy = preserveHierarchy;
+      }
+
+      bool getPreserveHierarchy() {
+        return models.preserveHierarchy;
+      }
     }
 
     namespace runtime {
@@ -21,12 +21,34 @@ namespace ammonite {
       void setShadowRes(int shadowRes);
       void setShadowFarPlane(float farPlane);
       void setGammaCorrection(bool gammaCorrection);
+      void setLodBias(float lodBias);
+      void setGpuMemoryBudget(int megabytes);
+      void setLightTiming(bool lightTiming);
 
       bool getVsync();
       float getFrameLimit();
       int getShadowRes();
       float getShadowFarPlane();
       bool getGammaCorrection();
+      float getLodBias();
+      int getGpuMemoryBudget();
+      bool getLightTiming();
+    }
+
+    namespace models {
+      void setCompactVertices(bool compactVertices);
+      void setOptimiseMeshes(bool optimiseMeshes);
+      void setOptimiseOverdraw(bool optimiseOverdraw);
+      void setGenerateLods(bool generateLods);
+      void setRetainMeshData(bool retainMeshData);
+      void setPreserveHierarchy(bool preserveHierarchy);
+
+      bool getCompactVertices();
+      bool getOptimiseMeshes();
+      bool getOptimiseOverdraw();
+      bool getGenerateLods();
+      bool getRetainMeshData();
+      bool getPreserveHierarchy();
     }
   }
 
@@ -5,6 +5,8 @@
 #include <fstream>
 #include <sstream>
 #include <filesystem>
+#include <map>
+#include <cstring>
 
 #include <GL/glew.h>
 
@@ -12,6 +14,8 @@
 #include "utils/logging.hpp"
 #include "utils/extension.hpp"
 #include "utils/cacheManager.hpp"
+#include "internal/cacheArchive.hpp"
+#include "utils/profiler.hpp"
 
 #include "internal/internalDebug.hpp"
 
@@ -19,64 +23,38 @@ namespace ammonite {
   namespace {
     //Vector to store all existing shaders
     std::vector<int> shaderIds(0);
+
+    //Programs that have been submitted, but not checked yet
+    struct PendingProgram {
+      std::vector<GLuint> shaderIds;
+      std::vector<std::string> shaderPaths;
+      bool cacheProgram;
+      unsigned long long int cacheKey;
+    };
+
+    std::map<GLuint, PendingProgram> pendingPrograms;
   }
 
   //Static helper functions
   namespace {
-    static void deleteCacheFile(std::string cacheFilePath) {
-      //Delete the cache and cacheinfo files
-      std::cout << ammonite::utils::status << "Clearing '" << cacheFilePath << "'" << std::endl;
-
-      ammonite::utils::files::deleteFile(cacheFilePath);
-      ammonite::utils::files::deleteFile(cacheFilePath + "info");
-    }
-
-    static void cacheShader(const GLuint programId, const char* shaderPaths[], const int shaderCount) {
-      std::string cacheFilePath = ammonite::utils::cache::requestNewCache(shaderPaths, shaderCount);
-      std::string cacheFileInfoPath = cacheFilePath + "info";
-
-      std::cout << ammonite::utils::status << "Caching '" << cacheFilePath << "'" << std::endl;
-      int binaryLength;
+    static void cacheShader(const GLuint programId, unsigned long long int cacheKey, const char* shaderPath) {
+      int binaryLength = 0;
       GLenum binaryFormat;
 
       //Get binary length and data of linked program
       glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
-      char binaryData[binaryLength];
-      glGetProgramBinary(programId, binaryLength, NULL, &binaryFormat, &binaryData);
-
-      if (binaryLength == 0) {
-        std::cerr << ammonite::utils::warning << "Failed to cache '" << cacheFilePath << "'" << std::endl;
-        return;
+      std::vector<char> binaryData(binaryLength);
+      if (binaryLength != 0) {
+        glGetProgramBinary(programId, binaryLength, NULL, &binaryFormat, binaryData.data());
       }
 
-      //Write the binary to cache directory
-      std::ofstream binarySave(cacheFilePath, std::ios::binary);
-      if (binarySave.is_open()) {
-        binarySave.write(&binaryData[0], binaryLength);
-      } else {
-        std::cerr << ammonite::utils::warning << "Failed to cache '" << cacheFilePath << "'" << std::endl;
-        deleteCacheFile(cacheFilePath);
+      if (binaryLength == 0 or !ammonite::utils::cache::archive::storeBinary(cacheKey,
+          binaryFormat, binaryData.data(), binaryLength)) {
+        std::cerr << ammonite::utils::warning << "Failed to cache program for '" << shaderPath << "'" << std::endl;
         return;
       }
 
-      //Write the cache info to cache directory
-      std::ofstream binaryInfo(cacheFileInfoPath);
-      if (binaryInfo.is_open()) {
-        for (int i = 0; i < shaderCount; i++) {
-          long long int filesize, modificationTime;
-          ammonite::utils::files::getFileMetadata(shaderPaths[i], &filesize, &modificationTime);
-
-          binaryInfo << "input;" << shaderPaths[i] << ";" << filesize << ";" << modificationTime << "\n";
-        }
-
-        binaryInfo << binaryFormat << "\n";
-        binaryInfo << binaryLength << "\n";
-
-        binaryInfo.close();
-      } else {
-        std::cerr << ammonite::utils::warning << "Failed to cache '" << cacheFileInfoPath << "'" << std::endl;
-        deleteCacheFile(cacheFilePath);
-      }
+      ammoniteInternalDebug << "Cached program for '" << shaderPath << "'" << std::endl;
     }
 
     static bool checkProgram(GLuint programId) {
@@ -100,49 +78,29 @@ namespace ammonite {
       return false;
     }
 
-    //Set by updateGLCacheSupport(), when GLEW loads
-    bool isBinaryCacheSupported = false;
-  }
-
-  //Internally exposed only
-  namespace shaders {
-    void updateGLCacheSupport() {
-      //Get number of supported formats
-      GLint numBinaryFormats = 0;
-      glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numBinaryFormats);
-
-      //Check support for collecting the program binary
-      if (!ammonite::utils::checkExtension("GL_ARB_get_program_binary", "GL_VERSION_4_1")) {
-        std::cerr << ammonite::utils::warning << "Program caching unsupported" << std::endl;
-        isBinaryCacheSupported = false;
-      } else if (numBinaryFormats < 1) {
-        std::cerr << ammonite::utils::warning << "Program caching unsupported (no supported formats)" << std::endl;
-        isBinaryCacheSupported = false;
+    //Insert preprocessor defines after the version directive, keeping line numbers in logs
+    static void insertDefines(std::string* shaderCode, const char* defines[], const int defineCount) {
+      std::string defineCode;
+      for (int i = 0; i < defineCount; i++) {
+        defineCode += std::string("#define ") + std::string(defines[i]) + std::string("\n");
       }
 
-      isBinaryCacheSupported = true;
-    }
-  }
-
-  namespace shaders {
-    void deleteShader(const GLuint shaderId) {
-      //Search for and delete shaderId
-      auto shaderPosition = std::find(shaderIds.begin(), shaderIds.end(), shaderId);
-      if (shaderPosition != shaderIds.end()) {
-        const int intShaderPosition = std::distance(shaderIds.begin(), shaderPosition);
-        glDeleteShader(shaderIds[intShaderPosition]);
-        shaderIds.erase(shaderPosition);
+      //The version directive must come first, so only insert after it if it's present
+      std::size_t insertPos = 0;
+      int versionLine = 1;
+      if (shaderCode->compare(0, 8, "#version") == 0) {
+        insertPos = shaderCode->find('\n');
+        insertPos = (insertPos == std::string::npos) ? shaderCode->size() : insertPos + 1;
+        versionLine = 2;
       }
-    }
 
-    //Delete every remaining shader
-    void eraseShaders() {
-      while (shaderIds.size() != 0) {
-        deleteShader(shaderIds[0]);
-      }
+      defineCode += std::string("#line ") + std::to_string(versionLine) + std::string("\n");
+      shaderCode->insert(insertPos, defineCode);
     }
 
-    int loadShader(const char* shaderPath, const GLenum shaderType, bool* externalSuccess) {
+    //Read and submit a shader for compiling, without waiting for the result
+    static GLuint submitShader(const char* shaderPath, const GLenum shaderType,
+                               const char* defines[], const int defineCount, bool* externalSuccess) {
       //Check for compute shader support if needed
       if (shaderType == GL_COMPUTE_SHADER) {
         if (!ammonite::utils::checkExtension("GL_ARB_compute_shader", "GL_VERSION_4_3")) {
@@ -161,9 +119,6 @@ namespace ammonite {
         }
       }
 
-      //Create the shader
-      GLuint shaderId = glCreateShader(shaderType);
-
       std::string shaderCode;
       std::ifstream shaderCodeStream(shaderPath, std::ios::in);
       std::stringstream sstr;
@@ -173,31 +128,163 @@ namespace ammonite {
         sstr << shaderCodeStream.rdbuf();
         shaderCode = sstr.str();
         shaderCodeStream.close();
+
+        if (defineCount > 0) {
+          insertDefines(&shaderCode, defines, defineCount);
+        }
       } else {
         std::cerr << ammonite::utils::warning << "Failed to open '" << shaderPath << "'" << std::endl;
         *externalSuccess = false;
         return 0;
       }
 
-      //Provide a shader source and compile the shader
+      //Create the shader, provide a shader source and compile the shader
+      GLuint shaderId = glCreateShader(shaderType);
       const char* shaderCodePointer = shaderCode.c_str();
       glShaderSource(shaderId, 1, &shaderCodePointer, NULL);
       glCompileShader(shaderId);
 
+      return shaderId;
+    }
+
+    static bool checkShader(GLuint shaderId, const char* shaderPath) {
       //Test whether the shader compiled
       GLint success = GL_FALSE;
       glGetShaderiv(shaderId, GL_COMPILE_STATUS, &success);
 
       //If the shader failed to compile, print a log
-      if (success == GL_FALSE) {
-        GLint maxLength = 0;
-        glGetShaderiv(shaderId, GL_INFO_LOG_LENGTH, &maxLength);
+      if (success == GL_TRUE) {
+        return true;
+      }
+
+      GLint maxLength = 0;
+      glGetShaderiv(shaderId, GL_INFO_LOG_LENGTH, &maxLength);
+
+      std::vector<GLchar> errorLog(maxLength);
+      glGetShaderInfoLog(shaderId, maxLength, &maxLength, &errorLog[0]);
+      std::cerr << ammonite::utils::warning << "\n" << shaderPath << ":" << std::endl;
+      std::cerr << ammonite::utils::warning << &errorLog[0] << std::endl;
+
+      return false;
+    }
+
+    //Set by updateGLCacheSupport(), when GLEW loads
+    bool isBinaryCacheSupported = false;
+    unsigned long long int driverHash = 0;
+
+    /*
+     - Key a program by its shader sources, shader types, defines and the driver
+     - Paths and timestamps are ignored, so a cache can be moved to another machine
+       with the same driver, and a driver update can't load incompatible binaries
+    */
+    static bool getProgramKey(const char* shaderPaths[], const GLenum shaderTypes[], const int shaderCount,
+                              const char* defines[], const int defineCount, unsigned long long int* cacheKey) {
+      std::vector<unsigned long long int> keyData = {driverHash};
+      for (int i = 0; i < defineCount; i++) {
+        keyData.push_back(ammonite::utils::files::hashData(defines[i], std::strlen(defines[i])));
+      }
+
+      for (int i = 0; i < shaderCount; i++) {
+        unsigned long long int sourceHash = 0;
+        if (!ammonite::utils::files::hashFile(shaderPaths[i], &sourceHash)) {
+          return false;
+        }
+
+        keyData.push_back(sourceHash);
+        keyData.push_back(shaderTypes[i]);
+      }
+
+      *cacheKey = ammonite::utils::files::hashData(keyData.data(),
+                                                   keyData.size() * sizeof(unsigned long long int));
+      return true;
+    }
+
+    //Set by updateParallelCompileSupport(), when GLEW loads
+    bool isParallelCompileSupported = false;
+  }
 
-        std::vector<GLchar> errorLog(maxLength);
-        glGetShaderInfoLog(shaderId, maxLength, &maxLength, &errorLog[0]);
-        std::cerr << ammonite::utils::warning << "\n" << shaderPath << ":" << std::endl;
-        std::cerr << ammonite::utils::warning << &errorLog[0] << std::endl;
+  //Internally exposed only
+  namespace shaders {
+    void updateGLCacheSupport() {
+      //Get number of supported formats
+      GLint numBinaryFormats = 0;
+      glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numBinaryFormats);
 
+      //Check support for collecting the program binary
+      if (!ammonite::utils::checkExtension("GL_ARB_get_program_binary", "GL_VERSION_4_1")) {
+        std::cerr << ammonite::utils::warning << "Program caching unsupported" << std::endl;
+        isBinaryCacheSupported = false;
+      } else if (numBinaryFormats < 1) {
+        std::cerr << ammonite::utils::warning << "Program caching unsupported (no supported formats)" << std::endl;
+        isBinaryCacheSupported = false;
+      } else {
+        isBinaryCacheSupported = true;
+      }
+
+      if (!isBinaryCacheSupported) {
+        return;
+      }
+
+      //Identify the driver by its strings and binary formats
+      std::string driverIdentity;
+      const GLenum driverStrings[3] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+      for (int i = 0; i < 3; i++) {
+        const char* driverString = (const char*)glGetString(driverStrings[i]);
+        if (driverString != nullptr) {
+          driverIdentity += std::string(driverString);
+        }
+        driverIdentity.push_back(';');
+      }
+
+      std::vector<GLint> binaryFormats(numBinaryFormats);
+      glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, binaryFormats.data());
+      for (int i = 0; i < numBinaryFormats; i++) {
+        driverIdentity += std::to_string(binaryFormats[i]) + std::string(";");
+      }
+
+      driverHash = ammonite::utils::files::hashData(driverIdentity.data(), driverIdentity.size());
+      ammoniteInternalDebug << "Program cache driver identity: '" << driverIdentity << "'" << std::endl;
+    }
+
+    //Let the driver compile and link on as many threads as it wants
+    void updateParallelCompileSupport() {
+      if (ammonite::utils::checkExtension("GL_KHR_parallel_shader_compile")) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        isParallelCompileSupported = true;
+      } else if (ammonite::utils::checkExtension("GL_ARB_parallel_shader_compile")) {
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        isParallelCompileSupported = true;
+      } else {
+        isParallelCompileSupported = false;
+      }
+    }
+  }
+
+  namespace shaders {
+    void deleteShader(const GLuint shaderId) {
+      //Search for and delete shaderId
+      auto shaderPosition = std::find(shaderIds.begin(), shaderIds.end(), shaderId);
+      if (shaderPosition != shaderIds.end()) {
+        const int intShaderPosition = std::distance(shaderIds.begin(), shaderPosition);
+        glDeleteShader(shaderIds[intShaderPosition]);
+        shaderIds.erase(shaderPosition);
+      }
+    }
+
+    //Delete every remaining shader
+    void eraseShaders() {
+      while (shaderIds.size() != 0) {
+        deleteShader(shaderIds[0]);
+      }
+    }
+
+    int loadShader(const char* shaderPath, const GLenum shaderType, bool* externalSuccess) {
+      GLuint shaderId = submitShader(shaderPath, shaderType, nullptr, 0, externalSuccess);
+      if (shaderId == 0) {
+        return 0;
+      }
+
+      if (!checkShader(shaderId, shaderPath)) {
         //Clean up and exit
         glDeleteShader(shaderId); //Use glDeleteShader, as the shader never made it to shaderIds
         *externalSuccess = false;
@@ -234,101 +321,156 @@ namespace ammonite {
       return programId;
     }
 
-    int createProgram(const char* shaderPaths[], const GLenum shaderTypes[], const int shaderCount, bool* externalSuccess) {
+    /*
+     - Submit a program for compiling and linking, then return without waiting
+     - The program must be passed to finishProgram() before it's used
+     - Cached programs are loaded immediately
+     - Each define is inserted into every shader, as '#define <define>', to build variants
+    */
+    int createProgramAsync(const char* shaderPaths[], const GLenum shaderTypes[], const int shaderCount,
+                           const char* defines[], const int defineCount, bool* externalSuccess) {
+      ammoniteProfileZone("createProgramAsync");
       //Used later as the return value
       GLuint programId;
 
       //Check for OpenGL and engine cache support
-      const bool isCacheSupported = isBinaryCacheSupported and ammonite::utils::cache::getCacheEnabled();
+      unsigned long long int cacheKey = 0;
+      const bool isCacheSupported = isBinaryCacheSupported and ammonite::utils::cache::getCacheEnabled() and
+        getProgramKey(shaderPaths, shaderTypes, shaderCount, defines, defineCount, &cacheKey);
 
       if (isCacheSupported) {
-        bool cacheValid = false;
-        std::string cacheFilePath = ammonite::utils::cache::requestCachedData(shaderPaths, shaderCount, &cacheValid);
-        std::string cacheFileInfoPath = cacheFilePath + "info";
-
-        //Attempt to get the shader format and size
-        GLenum cachedBinaryFormat = 0;
-        GLsizei cachedBinaryLength = 0;
-
-        if (cacheValid) {
-          std::string line;
-          std::ifstream cacheInfoFile(cacheFileInfoPath);
-          if (cacheInfoFile.is_open()) {
-            try {
-              //Skip input files
-              for (int i = 0; i < shaderCount; i++) {
-                getline(cacheInfoFile, line);
-              }
-
-              //Get the binary format
-              getline(cacheInfoFile, line);
-              cachedBinaryFormat = std::stoi(line);
-
-              //Get the length of the binary
-              getline(cacheInfoFile, line);
-              cachedBinaryLength = std::stoi(line);
-            } catch (const std::out_of_range&) {
-              cacheValid = false;
-            } catch (const std::invalid_argument&) {
-              cacheValid = false;
-            }
-
-            cacheInfoFile.close();
-          }
-        }
-
-        //If cache is still valid, attempt to use it
-        if (cacheValid) {
-          //Read the cached data from file
-          char cachedBinaryData[cachedBinaryLength];
-          std::ifstream input(cacheFilePath, std::ios::binary);
-          input.read(&cachedBinaryData[0], cachedBinaryLength);
-
-          //Load the cached binary data
+        unsigned int cachedBinaryFormat = 0;
+        unsigned long long int cachedBinaryLength = 0;
+        const char* cachedBinaryData = ammonite::utils::cache::archive::findBinary(cacheKey,
+          &cachedBinaryFormat, &cachedBinaryLength);
+
+        //Load the cached binary data straight from the mapped archive
+        if (cachedBinaryData != nullptr) {
+          ammoniteProfileInstant("Program cache hit");
           programId = glCreateProgram();
           glProgramBinary(programId, cachedBinaryFormat, cachedBinaryData, cachedBinaryLength);
 
-          //Return the program ID, unless the cache was faulty, then delete and carry on
+          //Return the program ID, unless the cache was faulty, then forget it and carry on
           if (checkProgram(programId)) {
             return programId;
           } else {
-            std::cerr << ammonite::utils::warning << "Failed to process '" << cacheFilePath << "'" << std::endl;
-            deleteCacheFile(cacheFilePath);
+            std::cerr << ammonite::utils::warning << "Failed to process cached program for '"
+                      << shaderPaths[0] << "'" << std::endl;
+            glDeleteProgram(programId);
+            ammonite::utils::cache::archive::removeBinary(cacheKey);
           }
-        } else {
-          //Shader source doesn't match cache, delete the old cache
-          if (cacheFilePath != "") {
-            deleteCacheFile(cacheFilePath);
+        }
+      }
+
+      //Since cache wasn't available, submit fresh shaders
+      if (isCacheSupported) {
+        ammoniteProfileInstant("Program cache miss");
+      }
+
+      PendingProgram pendingProgram;
+      pendingProgram.cacheProgram = isCacheSupported;
+      pendingProgram.cacheKey = cacheKey;
+      for (int i = 0; i < shaderCount; i++) {
+        bool hasSubmittedShader = true;
+        GLuint shaderId = submitShader(shaderPaths[i], shaderTypes[i], defines, defineCount, &hasSubmittedShader);
+
+        //Cleanup on failure
+        if (!hasSubmittedShader) {
+          for (unsigned int j = 0; j < pendingProgram.shaderIds.size(); j++) {
+            glDeleteShader(pendingProgram.shaderIds[j]);
           }
+
+          *externalSuccess = false;
+          return 0;
         }
+
+        pendingProgram.shaderIds.push_back(shaderId);
+        pendingProgram.shaderPaths.push_back(std::string(shaderPaths[i]));
       }
 
-      //Since cache wasn't available, generate fresh shaders
-      GLuint shaderIds[shaderCount];
+      //Link without checking the shaders, a failed shader fails the link too
+      programId = glCreateProgram();
       for (int i = 0; i < shaderCount; i++) {
-        shaderIds[i] = loadShader(shaderPaths[i], shaderTypes[i], externalSuccess);
+        glAttachShader(programId, pendingProgram.shaderIds[i]);
+      }
+      glLinkProgram(programId);
+
+      pendingPrograms[programId] = pendingProgram;
+      return programId;
+    }
+
+    //Return true if finishProgram() won't wait for the driver
+    bool isProgramReady(GLuint programId) {
+      if (!isParallelCompileSupported or pendingPrograms.find(programId) == pendingPrograms.end()) {
+        return true;
+      }
+
+      GLint isComplete = GL_FALSE;
+      glGetProgramiv(programId, GL_COMPLETION_STATUS_KHR, &isComplete);
+      return isComplete == GL_TRUE;
+    }
+
+    //Wait for a submitted program, check it linked and cache it, returns 0 on failure
+    int finishProgram(GLuint programId, bool* externalSuccess) {
+      ammoniteProfileZone("finishProgram");
+      auto it = pendingPrograms.find(programId);
+      if (it == pendingPrograms.end()) {
+        return programId;
       }
 
-      //Create the program like normal, as a valid cache wasn't found
+      PendingProgram* pendingProgram = &it->second;
       bool hasCreatedProgram = true;
-      programId = createProgram(shaderIds, shaderCount, &hasCreatedProgram);
+      for (unsigned int i = 0; i < pendingProgram->shaderIds.size(); i++) {
+        if (!checkShader(pendingProgram->shaderIds[i], pendingProgram->shaderPaths[i].c_str())) {
+          hasCreatedProgram = false;
+        }
+      }
+
+      if (hasCreatedProgram) {
+        hasCreatedProgram = checkProgram(programId);
+      }
+
+      //Detach and remove the shaders
+      for (unsigned int i = 0; i < pendingProgram->shaderIds.size(); i++) {
+        glDetachShader(programId, pendingProgram->shaderIds[i]);
+        glDeleteShader(pendingProgram->shaderIds[i]);
+      }
 
       //Cleanup on failure
       if (!hasCreatedProgram) {
+        glDeleteProgram(programId);
+        pendingPrograms.erase(it);
         *externalSuccess = false;
-        ammonite::shaders::eraseShaders();
         return 0;
       }
 
       //Cache the binary if enabled
-      if (isCacheSupported) {
-        cacheShader(programId, shaderPaths, shaderCount);
+      if (pendingProgram->cacheProgram) {
+        cacheShader(programId, pendingProgram->cacheKey, pendingProgram->shaderPaths[0].c_str());
       }
 
+      pendingPrograms.erase(it);
       return programId;
     }
 
-    int loadDirectory(const char* directoryPath, bool* externalSuccess) {
+    int createProgram(const char* shaderPaths[], const GLenum shaderTypes[], const int shaderCount, bool* externalSuccess) {
+      bool hasCreatedProgram = true;
+      GLuint programId = createProgramAsync(shaderPaths, shaderTypes, shaderCount, nullptr, 0, &hasCreatedProgram);
+      if (hasCreatedProgram) {
+        programId = finishProgram(programId, &hasCreatedProgram);
+      }
+
+      if (!hasCreatedProgram) {
+        *externalSuccess = false;
+        return 0;
+      }
+
+      return programId;
+    }
+
+    //Submit every shader in a directory as a program, see createProgramAsync()
+    int loadDirectoryAsync(const char* directoryPath, const char* defines[], const int defineCount,
+                           bool* externalSuccess) {
       const std::filesystem::path shaderDir{directoryPath};
       const auto it = std::filesystem::directory_iterator{shaderDir};
 
@@ -361,8 +503,32 @@ namespace ammonite {
         shaderTypes[i] = types[i];
       }
 
-      //Create the program and return the ID
-      return createProgram(shaderPaths, shaderTypes, shaderCount, externalSuccess);
+      //Submit the program and return the ID
+      return createProgramAsync(shaderPaths, shaderTypes, shaderCount, defines, defineCount, externalSuccess);
+    }
+
+    int loadDirectoryAsync(const char* directoryPath, bool* externalSuccess) {
+      return loadDirectoryAsync(directoryPath, nullptr, 0, externalSuccess);
+    }
+
+    int loadDirectory(const char* directoryPath, const char* defines[], const int defineCount,
+                      bool* externalSuccess) {
+      bool hasCreatedProgram = true;
+      GLuint programId = loadDirectoryAsync(directoryPath, defines, defineCount, &hasCreatedProgram);
+      if (hasCreatedProgram) {
+        programId = finishProgram(programId, &hasCreatedProgram);
+      }
+
+      if (!hasCreatedProgram) {
+        *externalSuccess = false;
+        return 0;
+      }
+
+      return programId;
+    }
+
+    int loadDirectory(const char* directoryPath, bool* externalSuccess) {
+      return loadDirectory(directoryPath, nullptr, 0, externalSuccess);
     }
   }
 }
@@ -5,12 +5,21 @@ namespace ammonite {
   namespace shaders {
     int createProgram(const GLuint shaderIds[], const int shaderCount, bool* externalSuccess);
     int createProgram(const char* shaderPaths[], const int shaderTypes[], const int shaderCount, bool* externalSuccess);
+    int createProgramAsync(const char* shaderPaths[], const GLenum shaderTypes[], const int shaderCount,
+                           const char* defines[], const int defineCount, bool* externalSuccess);
+    bool isProgramReady(GLuint programId);
+    int finishProgram(GLuint programId, bool* externalSuccess);
 
     int loadShader(const char* shaderPath, const GLenum shaderType, bool* externalSuccess);
     void deleteShader(GLuint shaderId);
     void eraseShaders();
 
     int loadDirectory(const char* directoryPath, bool* externalSuccess);
+    int loadDirectory(const char* directoryPath, const char* defines[], const int defineCount,
+                      bool* externalSuccess);
+    int loadDirectoryAsync(const char* directoryPath, bool* externalSuccess);
+    int loadDirectoryAsync(const char* directoryPath, const char* defines[], const int defineCount,
+                           bool* externalSuccess);
   }
 }
 
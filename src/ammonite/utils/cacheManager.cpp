@@ -6,6 +6,7 @@
 #include <functional>
 
 #include "../internal/fileManager.hpp"
+#include "../internal/cacheArchive.hpp"
 #include "../utils/logging.hpp"
 
 #include "../internal/internalDebug.hpp"
@@ -54,6 +55,9 @@ namespace ammonite {
           dataCacheDir.push_back('/');
         }
 
+        //Map the shader binary archive once, lookups after this don't touch the disk
+        archive::openArchive(dataCacheDir + std::string("shaders.archive"));
+
         std::cout << ammonite::utils::status << "Data caching enabled ('" << dataCacheDir << "')" << std::endl;
         return true;
       }
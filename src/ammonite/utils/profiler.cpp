@@ -0,0 +1,340 @@
+#ifdef PROFILE
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <mutex>
+
+#include "profiler.hpp"
+#include "timer.hpp"
+#include "logging.hpp"
+
+#include "../internal/internalDebug.hpp"
+
+namespace ammonite {
+  namespace utils {
+    namespace profiler {
+      namespace {
+        //Events each thread can hold before they're collected, must be a power of 2
+        const unsigned long long int RING_CAPACITY = 1 << 14;
+
+        /*
+         - Each thread writes to its own ring, and only collectEvents() reads from it
+         - With one writer and one reader, the indices are enough to keep it lock-free
+        */
+        struct ThreadRing {
+          int threadIndex;
+          std::atomic<unsigned long long int> writeIndex{0};
+          std::atomic<unsigned long long int> readIndex{0};
+          ProfileEvent events[RING_CAPACITY];
+        };
+
+        std::atomic<bool> isProfilingEnabled{true};
+        std::atomic<long> droppedEvents{0};
+
+        //Rings are only locked to add or walk the list, never to record events
+        std::mutex ringListMutex;
+        std::vector<std::unique_ptr<ThreadRing>> threadRings;
+        thread_local ThreadRing* threadRing = nullptr;
+
+        //Zones that have begun but not ended on this thread, each keeps a slot free for its end
+        thread_local unsigned long long int openZones = 0;
+
+        //Frames to keep collecting after a capture ends, so late GPU results are included
+        const int GPU_SETTLE_FRAMES = 5;
+
+        //Trace thread ID used for GPU passes, kept clear of CPU thread indices
+        const int GPU_THREAD_ID = 1000;
+
+        struct GpuEvent {
+          const char* passName;
+          long long int beginTime;
+          long long int endTime;
+        };
+
+        //Capture state, only used from the thread calling drawFrame()
+        struct {
+          std::string outputPath;
+          int framesLeft = 0;
+          int settleFramesLeft = 0;
+          long long int startTime = 0;
+          long long int endTime = 0;
+          long droppedEvents = 0;
+          bool wasEnabled = true;
+          std::vector<ProfileEvent> events;
+          std::vector<GpuEvent> gpuEvents;
+        } capture;
+        bool isCaptureActive = false;
+      }
+
+      namespace {
+        static ThreadRing* createThreadRing() {
+          std::lock_guard<std::mutex> lock(ringListMutex);
+          threadRings.push_back(std::make_unique<ThreadRing>());
+          threadRings.back()->threadIndex = threadRings.size() - 1;
+          return threadRings.back().get();
+        }
+
+        //Trace files use microseconds, keep the nanoseconds as decimals
+        static std::string formatTime(long long int nanoseconds) {
+          char buffer[32];
+          std::snprintf(buffer, sizeof(buffer), "%.3f", double(nanoseconds) / 1000.0);
+          return std::string(buffer);
+        }
+
+        static std::string escapeName(const char* name) {
+          std::string escapedName;
+          for (const char* character = name; *character != '\0'; character++) {
+            if (*character == '"' or *character == '\\') {
+              escapedName += '\\';
+            }
+            escapedName += *character;
+          }
+
+          return escapedName;
+        }
+
+        static void writeCompleteEvent(std::ofstream* output, const char* name, const char* category,
+                                       int threadId, long long int beginTime, long long int endTime) {
+          *output << ",\n{\"name\":\"" << escapeName(name) << "\",\"cat\":\"" << category
+                  << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << threadId << ",\"ts\":"
+                  << formatTime(beginTime - capture.startTime) << ",\"dur\":"
+                  << formatTime(endTime - beginTime) << "}";
+        }
+
+        /*
+         - Pair up zone events into complete events, so zones cut off by the capture still show
+         - Zones that began after the capture ended are left out
+        */
+        static bool writeTrace() {
+          std::ofstream output(capture.outputPath);
+          if (!output.is_open()) {
+            return false;
+          }
+
+          output << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+          output << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"Ammonite\"}}";
+          output << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << GPU_THREAD_ID
+                 << ",\"args\":{\"name\":\"GPU\"}}";
+
+          //Events from each thread are in order, so a stack per thread matches begins to ends
+          std::map<int, std::vector<ProfileEvent>> openZoneStacks;
+          long long int lastTime = capture.endTime;
+          for (unsigned int i = 0; i < capture.events.size(); i++) {
+            ProfileEvent* event = &capture.events[i];
+            std::vector<ProfileEvent>* openZoneStack = &openZoneStacks[event->threadIndex];
+            lastTime = std::max(lastTime, event->timestamp);
+
+            if (event->type == ZONE_BEGIN) {
+              openZoneStack->push_back(*event);
+            } else if (event->type == ZONE_END) {
+              //Zones that were already open when the capture started begin with it
+              long long int beginTime = capture.startTime;
+              if (!openZoneStack->empty()) {
+                beginTime = openZoneStack->back().timestamp;
+                openZoneStack->pop_back();
+              }
+
+              if (beginTime < capture.endTime) {
+                writeCompleteEvent(&output, event->zoneName, "cpu", event->threadIndex,
+                                   beginTime, event->timestamp);
+              }
+            } else if (event->timestamp < capture.endTime) {
+              output << ",\n{\"name\":\"" << escapeName(event->zoneName)
+                     << "\",\"cat\":\"event\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":"
+                     << event->threadIndex << ",\"ts\":" << formatTime(event->timestamp - capture.startTime) << "}";
+            }
+          }
+
+          //Name each CPU thread, and close zones that never ended at the last recorded time
+          for (auto it = openZoneStacks.begin(); it != openZoneStacks.end(); it++) {
+            output << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << it->first
+                   << ",\"args\":{\"name\":\"CPU thread " << it->first << "\"}}";
+
+            for (unsigned int i = 0; i < it->second.size(); i++) {
+              ProfileEvent* event = &it->second[i];
+              if (event->timestamp < capture.endTime) {
+                writeCompleteEvent(&output, event->zoneName, "cpu", it->first, event->timestamp, lastTime);
+              }
+            }
+          }
+
+          for (unsigned int i = 0; i < capture.gpuEvents.size(); i++) {
+            GpuEvent* event = &capture.gpuEvents[i];
+            if (event->beginTime >= capture.startTime and event->beginTime < capture.endTime) {
+              writeCompleteEvent(&output, event->passName, "gpu", GPU_THREAD_ID,
+                                 event->beginTime, event->endTime);
+            }
+          }
+
+          output << "\n]}\n";
+          output.close();
+          return bool(output);
+        }
+      }
+
+      namespace internal {
+        /*
+         - Returns false if the event wasn't recorded, because profiling is off or the ring is full
+         - Ends are always recorded, as their begin reserved space for them
+        */
+        bool recordEvent(const char* zoneName, EventType type) {
+          if (type != ZONE_END) {
+            if (!isProfilingEnabled.load(std::memory_order_relaxed)) {
+              return false;
+            }
+
+            if (threadRing == nullptr) {
+              threadRing = createThreadRing();
+            }
+          }
+
+          unsigned long long int writeIndex = threadRing->writeIndex.load(std::memory_order_relaxed);
+          if (type != ZONE_END) {
+            //Begins need space for their end too, instant events only need their own
+            unsigned long long int usedSlots = writeIndex - threadRing->readIndex.load(std::memory_order_acquire);
+            unsigned long long int requiredSlots = (type == ZONE_BEGIN) ? 2 : 1;
+            if (usedSlots + openZones + requiredSlots > RING_CAPACITY) {
+              droppedEvents.fetch_add(1, std::memory_order_relaxed);
+              return false;
+            }
+          }
+
+          if (type == ZONE_BEGIN) {
+            openZones++;
+          } else if (type == ZONE_END) {
+            openZones--;
+          }
+
+          threadRing->events[writeIndex & (RING_CAPACITY - 1)] = {zoneName, getNanoTime(),
+                                                                threadRing->threadIndex, type};
+          threadRing->writeIndex.store(writeIndex + 1, std::memory_order_release);
+          return true;
+        }
+      }
+
+      void setEnabled(bool enabled) {
+        isProfilingEnabled.store(enabled, std::memory_order_relaxed);
+      }
+
+      bool getEnabled() {
+        return isProfilingEnabled.load(std::memory_order_relaxed);
+      }
+
+      //Move every recorded event into events, freeing space in the rings
+      void collectEvents(std::vector<ProfileEvent>* events) {
+        std::lock_guard<std::mutex> lock(ringListMutex);
+        for (unsigned int i = 0; i < threadRings.size(); i++) {
+          ThreadRing* ring = threadRings[i].get();
+          unsigned long long int readIndex = ring->readIndex.load(std::memory_order_relaxed);
+          unsigned long long int writeIndex = ring->writeIndex.load(std::memory_order_acquire);
+
+          for (; readIndex < writeIndex; readIndex++) {
+            events->push_back(ring->events[readIndex & (RING_CAPACITY - 1)]);
+          }
+
+          ring->readIndex.store(readIndex, std::memory_order_release);
+        }
+      }
+
+      long getDroppedEvents() {
+        return droppedEvents.load(std::memory_order_relaxed);
+      }
+
+      /*
+       - Record the next frameCount frames, then write them to outputPath as a Chrome trace
+       - Open the result with chrome://tracing or Perfetto
+       - Profiling is enabled for the capture, then restored afterwards
+      */
+      bool startCapture(const char* outputPath, int frameCount) {
+        if (isCaptureActive) {
+          std::cerr << ammonite::utils::warning << "A capture is already running" << std::endl;
+          return false;
+        }
+
+        if (frameCount <= 0) {
+          std::cerr << ammonite::utils::warning << "Captures need at least 1 frame" << std::endl;
+          return false;
+        }
+
+        //Discard anything recorded before the capture
+        std::vector<ProfileEvent> oldEvents;
+        collectEvents(&oldEvents);
+
+        capture.outputPath = outputPath;
+        capture.framesLeft = frameCount;
+        capture.settleFramesLeft = GPU_SETTLE_FRAMES;
+        capture.wasEnabled = getEnabled();
+        capture.droppedEvents = getDroppedEvents();
+        capture.events.clear();
+        capture.gpuEvents.clear();
+        capture.startTime = getNanoTime();
+        capture.endTime = 0;
+
+        setEnabled(true);
+        isCaptureActive = true;
+        return true;
+      }
+
+      bool isCapturing() {
+        return isCaptureActive;
+      }
+
+      namespace internal {
+        //Record a GPU pass, with timestamps already converted to the CPU's clock
+        void recordGpuEvent(const char* passName, long long int beginTime, long long int endTime) {
+          if (isCaptureActive) {
+            capture.gpuEvents.push_back({passName, beginTime, endTime});
+          }
+        }
+
+        //Collect the frame's events, then write the capture once every frame and GPU result is in
+        void endFrame() {
+          if (!isCaptureActive) {
+            return;
+          }
+
+          collectEvents(&capture.events);
+          if (capture.framesLeft > 0) {
+            capture.framesLeft--;
+            if (capture.framesLeft == 0) {
+              capture.endTime = getNanoTime();
+            }
+            return;
+          }
+
+          capture.settleFramesLeft--;
+          if (capture.settleFramesLeft > 0) {
+            return;
+          }
+
+          isCaptureActive = false;
+          setEnabled(capture.wasEnabled);
+          if (getDroppedEvents() != capture.droppedEvents) {
+            std::cerr << ammonite::utils::warning << "Profile buffers filled during capture, "
+                      << getDroppedEvents() - capture.droppedEvents << " events dropped" << std::endl;
+          }
+
+          if (writeTrace()) {
+            std::cout << ammonite::utils::status << "Saved capture to '" << capture.outputPath
+                      << "'" << std::endl;
+          } else {
+            std::cerr << ammonite::utils::warning << "Failed to save capture to '"
+                      << capture.outputPath << "'" << std::endl;
+          }
+
+          capture.events.clear();
+          capture.gpuEvents.clear();
+        }
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef PROFILER
+#define PROFILER
+
+/*
+ - Profile zones record a begin and end event for the scope they're declared in
+ - Instant events mark a single point in time, such as a cache hit or miss
+ - Zones are compiled out unless PROFILE is set, and can be disabled at runtime
+ - Captures write a number of frames to a Chrome trace event JSON file
+*/
+
+#ifdef PROFILE
+#include <vector>
+
+namespace ammonite {
+  namespace utils {
+    namespace profiler {
+      enum EventType {
+        ZONE_BEGIN = 0,
+        ZONE_END = 1,
+        INSTANT = 2
+      };
+
+      struct ProfileEvent {
+        const char* zoneName;
+        long long int timestamp;
+        int threadIndex;
+        EventType type;
+      };
+
+      void setEnabled(bool enabled);
+      bool getEnabled();
+      void collectEvents(std::vector<ProfileEvent>* events);
+      long getDroppedEvents();
+
+      bool startCapture(const char* outputPath, int frameCount);
+      bool isCapturing();
+
+      namespace internal {
+        bool recordEvent(const char* zoneName, EventType type);
+        void recordGpuEvent(const char* passName, long long int beginTime, long long int endTime);
+        void endFrame();
+      }
+
+      class ProfileZone {
+        public:
+          ProfileZone(const char* name) {
+            zoneName = name;
+            hasBegun = internal::recordEvent(zoneName, ZONE_BEGIN);
+          }
+
+          ~ProfileZone() {
+            //Only end zones that began, so a full buffer can't leave unmatched events
+            if (hasBegun) {
+              internal::recordEvent(zoneName, ZONE_END);
+            }
+          }
+
+        private:
+          const char* zoneName;
+          bool hasBegun;
+      };
+    }
+  }
+}
+
+  #define ammoniteProfileZoneJoin(name, line) name##line
+  #define ammoniteProfileZoneName(line) ammoniteProfileZoneJoin(ammoniteProfileZone, line)
+  #define ammoniteProfileZone(zoneName) \
+  ammonite::utils::profiler::ProfileZone ammoniteProfileZoneName(__LINE__)(zoneName)
+  #define ammoniteProfileInstant(eventName) \
+  ammonite::utils::profiler::internal::recordEvent(eventName, ammonite::utils::profiler::INSTANT)
+#else
+  #define ammoniteProfileZone(zoneName)
+  #define ammoniteProfileInstant(eventName)
+#endif
+
+#endif
@@ -6,30 +6,26 @@
 namespace ammonite {
   namespace utils {
     namespace {
-      static double getNanoTime() {
-        auto systemTime = std::chrono::system_clock::now().time_since_epoch();
-        auto systemTimeNano = std::chrono::duration_cast<std::chrono::nanoseconds>(systemTime).count();
-        return systemTimeNano;
-      }
-
-      static double getTimeDelta() {
-        static const double initTime = getNanoTime();
-        double systemTime = getNanoTime() - initTime;
-
-        //Convert nanoseconds into seconds
-        return systemTime / 1000000000;
+      //Monotonic time in nanoseconds, unaffected by changes to the system clock
+      static long long int getNanoTime() {
+        auto steadyTime = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(steadyTime).count();
       }
     }
 
     class Timer {
       public:
         double getTime() {
+          long long int elapsedTime;
           if (isTimerRunning) {
-            return getTimeDelta() - startTime - offset;
+            elapsedTime = getNanoTime() - startTime - offset;
           } else {
             //If the timer hasn't been unpaused yet, correct for the time
-            return stopTime - startTime - offset;
+            elapsedTime = stopTime - startTime - offset;
           }
+
+          //Convert nanoseconds into seconds
+          return double(elapsedTime) / 1000000000.0;
         }
 
         bool isRunning() {
@@ -37,30 +33,30 @@ namespace ammonite {
         }
 
         void reset() {
-          startTime = getTimeDelta();
-          stopTime = 0.0;
-          offset = 0.0;
+          startTime = getNanoTime();
+          stopTime = startTime;
+          offset = 0;
         }
 
         void pause() {
           if (isTimerRunning) {
-            stopTime = getTimeDelta();
+            stopTime = getNanoTime();
             isTimerRunning = false;
           }
         }
 
         void unpause() {
           if (!isTimerRunning) {
-            offset += getTimeDelta() - stopTime;
+            offset += getNanoTime() - stopTime;
             isTimerRunning = true;
           }
         }
 
       private:
         bool isTimerRunning = true;
-        double startTime = getTimeDelta();
-        double stopTime = 0.0;
-        double offset = 0.0;
+        long long int startTime = getNanoTime();
+        long long int stopTime = startTime;
+        long long int offset = 0;
     };
   }
 }
@@ -10,6 +10,7 @@
 
 #include "internal/internalSettings.hpp"
 #include "internal/shaderCacheUpdate.hpp"
+#include "internal/headless.hpp"
 #include "utils/logging.hpp"
 
 #include "internal/internalDebug.hpp"
@@ -54,19 +55,31 @@ namespace ammonite {
         return true;
       }
 
-      //Initialise GLEW
+      //Initialise GLEW, window can be nullptr for headless contexts
       bool setupGlew(GLFWwindow* window) {
         glewExperimental = GL_TRUE;
-        if (glewInit() != GLEW_OK) {
+        GLenum glewError = glewInit();
+
+        //GLEW built for GLX still loads every function for an EGL context, but reports no display
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+        if (glewError == GLEW_ERROR_NO_GLX_DISPLAY and ammonite::headless::isHeadless()) {
+          glewError = GLEW_OK;
+        }
+#endif
+
+        if (glewError != GLEW_OK) {
           std::cerr << ammonite::utils::error << "Failed to initialize GLEW" << std::endl;
           return false;
         }
 
         //Update values when resized
-        glfwSetWindowSizeCallback(window, window_size_callback);
+        if (window != nullptr) {
+          glfwSetWindowSizeCallback(window, window_size_callback);
+        }
 
-        //Prompt shader cache setup
+        //Prompt shader cache and parallel compile setup
         ammonite::shaders::updateGLCacheSupport();
+        ammonite::shaders::updateParallelCompileSupport();
 
         return true;
       }
@@ -184,5 +197,31 @@ namespace ammonite {
     GLFWwindow* setupWindow(int width, int height, int antialiasing) {
       return setupWindow(width, height, antialiasing, DEFAULT_TITLE);
     }
+
+    /*
+     - Create a context without a window or display, drawing into a framebuffer of the given size
+     - Pass nullptr as the renderer's window, then draw frames as usual
+     - Uses EGL, so it works on software drivers such as llvmpipe
+    */
+    bool setupHeadless(int width, int height) {
+      ammonite::settings::runtime::internal::setWidth(width);
+      ammonite::settings::runtime::internal::setHeight(height);
+
+      if (!ammonite::headless::createContext()) {
+        return false;
+      }
+
+      if (!windowManager::setup::setupGlew(nullptr) or
+          !ammonite::headless::createFramebuffer(width, height)) {
+        ammonite::headless::destroyContext();
+        return false;
+      }
+
+      return true;
+    }
+
+    void destroyHeadless() {
+      ammonite::headless::destroyContext();
+    }
   }
 }
@@ -20,6 +20,9 @@ namespace ammonite {
 
     GLFWwindow* setupWindow(int width, int height, int antialiasing, const char* title);
     GLFWwindow* setupWindow(int width, int height, int antialiasing);
+
+    bool setupHeadless(int width, int height);
+    void destroyHeadless();
   }
 }
 
@@ -0,0 +1,669 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "ammonite/ammonite.hpp"
+#include "common/argHandler.hpp"
+
+/*
+ - Renders synthetic scenes headlessly along a scripted camera path, then reports a JSON summary
+ - Each scenario sets the model count, light count, shadow resolution and instancing ratio
+ - The instancing ratio is the share of models that copy another model's mesh, instead of loading their own
+ - Import throughput is measured first, on a large model split into several meshes
+ - Transform updates are then timed, by moving every model of a scene each frame
+*/
+
+struct Scenario {
+  std::string name;
+  int modelCount;
+  int lightCount;
+  int shadowRes;
+  float instancingRatio;
+};
+
+struct ScenarioResult {
+  Scenario scenario;
+  int uniqueMeshCount;
+  ammonite::renderer::FrameStats frameStats;
+  double gpuPassTimes[4];
+  double cpuUsage;
+  double drawCalls, triangles, textureBinds, programSwitches, bufferUploads, uploadedBytes;
+};
+
+struct TransformResult {
+  int modelCount;
+  int frameCount;
+  double setPositionTime, setRotationTime;
+  double setPositionsTime, setRotationsTime;
+  double staticFrameTime, movingFrameTime, batchedFrameTime;
+};
+
+struct ImportResult {
+  std::string name;
+  int threadCount;
+  int triangleCount;
+  double importTime;
+};
+
+namespace {
+  const float GRID_SPACING = 3.0f;
+  const char* MESH_DIRECTORY = "ammonite-benchmark";
+  const char* TEXTURE_PATH = "assets/flat.png";
+
+  //Scene meshes are single small spheres, the import model is split into several large ones
+  const int SCENE_STACKS = 16;
+  const int IMPORT_MESH_COUNT = 16;
+}
+
+//Write a UV sphere with twice as many slices as stacks, after firstVertex vertices
+static void writeSphere(std::ostream* output, int stacks, glm::vec3 centre, int firstVertex) {
+  const int slices = stacks * 2;
+  for (int stack = 0; stack <= stacks; stack++) {
+    float phi = glm::pi<float>() * float(stack) / stacks;
+    for (int slice = 0; slice <= slices; slice++) {
+      float theta = glm::two_pi<float>() * float(slice) / slices;
+      glm::vec3 normal(std::sin(phi) * std::cos(theta), std::cos(phi), std::sin(phi) * std::sin(theta));
+      glm::vec3 vertex = centre + normal;
+      *output << "v " << vertex.x << " " << vertex.y << " " << vertex.z << "\n";
+      *output << "vn " << normal.x << " " << normal.y << " " << normal.z << "\n";
+      *output << "vt " << float(slice) / slices << " " << float(stack) / stacks << "\n";
+    }
+  }
+
+  for (int stack = 0; stack < stacks; stack++) {
+    for (int slice = 0; slice < slices; slice++) {
+      //Two counter-clockwise triangles per quad, OBJ indices start from 1
+      int a = firstVertex + stack * (slices + 1) + slice + 1;
+      int b = a + slices + 1;
+      *output << "f " << a << "/" << a << "/" << a << " " << a + 1 << "/" << a + 1 << "/" << a + 1 << " "
+              << b << "/" << b << "/" << b << "\n";
+      *output << "f " << a + 1 << "/" << a + 1 << "/" << a + 1 << " " << b + 1 << "/" << b + 1 << "/" << b + 1 << " "
+              << b << "/" << b << "/" << b << "\n";
+    }
+  }
+}
+
+//Write a row of spheres as separate objects of an OBJ, the comment keeps each file's contents unique
+static bool writeMesh(const std::string& meshPath, int meshIndex, int sphereCount, int stacks) {
+  std::ofstream output(meshPath);
+  if (!output.is_open()) {
+    return false;
+  }
+
+  output << "# Benchmark mesh " << meshIndex << "\n";
+  const int sphereVertices = (stacks + 1) * (stacks * 2 + 1);
+  for (int i = 0; i < sphereCount; i++) {
+    output << "o sphere" << i << "\n";
+    writeSphere(&output, stacks, glm::vec3(i * GRID_SPACING, 0.0f, 0.0f), i * sphereVertices);
+  }
+
+  output.close();
+  return bool(output);
+}
+
+/*
+ - Time importing the same model with one thread, then with every thread
+ - Meshes are converted in parallel, so the difference shows what that saves
+ - The model is imported once first, so both runs read it from the page cache
+*/
+static bool runImport(const std::string& meshDirectory, int triangleCount,
+                      std::vector<ImportResult>* results) {
+  //Each sphere has 4 * stacks^2 triangles
+  int stacks = std::max(int(std::lround(std::sqrt(triangleCount / (4.0 * IMPORT_MESH_COUNT)))), 1);
+  triangleCount = 4 * stacks * stacks * IMPORT_MESH_COUNT;
+  std::string meshPath = meshDirectory + "/import" + std::to_string(stacks) + ".obj";
+  if (!std::filesystem::exists(meshPath) and !writeMesh(meshPath, 0, IMPORT_MESH_COUNT, stacks)) {
+    std::cerr << "Failed to write '" << meshPath << "'" << std::endl;
+    return false;
+  }
+
+  const int maxThreads = omp_get_max_threads();
+  const int threadCounts[3] = {maxThreads, 1, maxThreads};
+  const char* names[3] = {"import-warmup", "import-serial", "import-parallel"};
+  for (int i = 0; i < 3; i++) {
+    bool success = true;
+    omp_set_num_threads(threadCounts[i]);
+    ammonite::utils::Timer importTimer;
+    int modelId = ammonite::models::createModel(meshPath.c_str(), &success);
+    double importTime = importTimer.getTime();
+    if (!success) {
+      omp_set_num_threads(maxThreads);
+      return false;
+    }
+
+    ammonite::models::deleteModel(modelId);
+    if (i > 0) {
+      results->push_back({names[i], threadCounts[i], triangleCount, importTime});
+    }
+  }
+
+  omp_set_num_threads(maxThreads);
+  return true;
+}
+
+//Point the active camera at the centre of the scene, from a deterministic orbit
+static void placeCamera(int frame, int frameCount, glm::vec3 centre, float radius) {
+  float angle = glm::two_pi<float>() * float(frame) / float(frameCount);
+  glm::vec3 position = centre + glm::vec3(std::sin(angle) * radius, radius * 0.5f, std::cos(angle) * radius);
+  glm::vec3 direction = glm::normalize(centre - position);
+
+  int cameraId = ammonite::camera::getActiveCamera();
+  ammonite::camera::setPosition(cameraId, position);
+  ammonite::camera::setHorizontal(cameraId, std::atan2(direction.x, direction.z));
+  ammonite::camera::setVertical(cameraId, std::asin(direction.y));
+}
+
+/*
+ - Draw copies of a model on a grid, first still, then moving every model each frame
+   with one setter call per model, then with the batched setters
+ - Setter calls are timed directly, every frame of a moving scene also rebuilds each model's matrices
+ - The difference between still and moving drawFrame() times is the matrix update cost
+*/
+static bool runTransforms(const std::string& meshDirectory, int modelCount, int warmupFrames,
+                          int frameCount, TransformResult* result) {
+  std::string meshPath = meshDirectory + "/mesh0.obj";
+  if (!std::filesystem::exists(meshPath) and !writeMesh(meshPath, 0, 1, SCENE_STACKS)) {
+    std::cerr << "Failed to write '" << meshPath << "'" << std::endl;
+    return false;
+  }
+
+  bool success = true;
+  std::vector<int> modelIds(modelCount);
+  modelIds[0] = ammonite::models::createModel(meshPath.c_str(), &success);
+  if (!success) {
+    return false;
+  }
+
+  for (int i = 1; i < modelCount; i++) {
+    modelIds[i] = ammonite::models::copyModel(modelIds[0]);
+  }
+
+  int gridSize = std::ceil(std::sqrt(float(modelCount)));
+  std::vector<glm::vec3> positions(modelCount);
+  for (int i = 0; i < modelCount; i++) {
+    positions[i] = glm::vec3((i % gridSize) * GRID_SPACING, 0.0f, (i / gridSize) * GRID_SPACING);
+    ammonite::models::position::setPosition(modelIds[i], positions[i]);
+  }
+
+  float gridWidth = (gridSize - 1) * GRID_SPACING;
+  glm::vec3 centre(gridWidth / 2.0f, 0.0f, gridWidth / 2.0f);
+  placeCamera(0, 1, centre, gridWidth * 0.75f + 5.0f);
+
+  //Run the same frames still, then moving with each setter, then moving with the batched setters
+  double setTimes[4] = {0.0, 0.0, 0.0, 0.0};
+  double frameTimes[3] = {0.0, 0.0, 0.0};
+  std::vector<glm::vec3> movedPositions(modelCount);
+  std::vector<glm::vec3> rotations(modelCount);
+  ammonite::utils::Timer timer;
+  for (int pass = 0; pass < 3; pass++) {
+    for (int frame = -warmupFrames; frame < frameCount; frame++) {
+      if (pass == 1) {
+        //Bob and spin each model, one setter call each
+        glm::vec3 offset(0.0f, std::sin(float(frame) * 0.1f), 0.0f);
+        timer.reset();
+        for (int i = 0; i < modelCount; i++) {
+          ammonite::models::position::setPosition(modelIds[i], positions[i] + offset);
+        }
+        double positionTime = timer.getTime();
+
+        glm::vec3 rotation(0.0f, float(frame) * 0.05f, 0.0f);
+        timer.reset();
+        for (int i = 0; i < modelCount; i++) {
+          ammonite::models::position::setRotation(modelIds[i], rotation);
+        }
+        double rotationTime = timer.getTime();
+
+        if (frame >= 0) {
+          setTimes[0] += positionTime;
+          setTimes[1] += rotationTime;
+        }
+      } else if (pass == 2) {
+        //Same movement, one batched call for every model
+        glm::vec3 offset(0.0f, std::sin(float(frame) * 0.1f), 0.0f);
+        glm::vec3 rotation(0.0f, float(frame) * 0.05f, 0.0f);
+        for (int i = 0; i < modelCount; i++) {
+          movedPositions[i] = positions[i] + offset;
+          rotations[i] = rotation;
+        }
+
+        timer.reset();
+        ammonite::models::position::setPositions(modelIds.data(), movedPositions.data(), modelCount);
+        double positionTime = timer.getTime();
+
+        timer.reset();
+        ammonite::models::position::setRotations(modelIds.data(), rotations.data(), modelCount);
+        double rotationTime = timer.getTime();
+
+        if (frame >= 0) {
+          setTimes[2] += positionTime;
+          setTimes[3] += rotationTime;
+        }
+      }
+
+      timer.reset();
+      ammonite::renderer::drawFrame(modelIds.data(), modelCount);
+      if (frame >= 0) {
+        frameTimes[pass] += timer.getTime();
+      }
+    }
+  }
+
+  result->modelCount = modelCount;
+  result->frameCount = frameCount;
+  result->setPositionTime = setTimes[0] / frameCount;
+  result->setRotationTime = setTimes[1] / frameCount;
+  result->setPositionsTime = setTimes[2] / frameCount;
+  result->setRotationsTime = setTimes[3] / frameCount;
+  result->staticFrameTime = frameTimes[0] / frameCount;
+  result->movingFrameTime = frameTimes[1] / frameCount;
+  result->batchedFrameTime = frameTimes[2] / frameCount;
+
+  for (int i = 0; i < modelCount; i++) {
+    ammonite::models::deleteModel(modelIds[i]);
+  }
+
+  return true;
+}
+
+static bool runScenario(const Scenario& scenario, const std::string& meshDirectory,
+                        int warmupFrames, int frameCount, ScenarioResult* result) {
+  ammonite::settings::graphics::setShadowRes(scenario.shadowRes);
+
+  //Load the unique meshes, then fill the rest of the scene with copies
+  int uniqueMeshCount = std::lround(scenario.modelCount * (1.0f - scenario.instancingRatio));
+  uniqueMeshCount = std::min(std::max(uniqueMeshCount, 1), scenario.modelCount);
+
+  bool success = true;
+  std::vector<int> modelIds;
+  for (int i = 0; success and i < scenario.modelCount; i++) {
+    if (i < uniqueMeshCount) {
+      std::string meshPath = meshDirectory + "/mesh" + std::to_string(i) + ".obj";
+      if (!std::filesystem::exists(meshPath) and !writeMesh(meshPath, i, 1, SCENE_STACKS)) {
+        std::cerr << "Failed to write '" << meshPath << "'" << std::endl;
+        success = false;
+        break;
+      }
+
+      int modelId = ammonite::models::createModel(meshPath.c_str(), &success);
+      if (!success) {
+        break;
+      }
+
+      modelIds.push_back(modelId);
+      ammonite::models::applyTexture(modelId, TEXTURE_PATH, true, &success);
+    } else {
+      modelIds.push_back(ammonite::models::copyModel(modelIds[i % uniqueMeshCount]));
+    }
+  }
+
+  //Lay the models out on a square grid
+  int gridSize = std::ceil(std::sqrt(float(scenario.modelCount)));
+  for (int i = 0; success and i < scenario.modelCount; i++) {
+    glm::vec3 position((i % gridSize) * GRID_SPACING, 0.0f, (i / gridSize) * GRID_SPACING);
+    ammonite::models::position::setPosition(modelIds[i], position);
+  }
+
+  //Spread the lights in a ring above the grid
+  float gridWidth = (gridSize - 1) * GRID_SPACING;
+  glm::vec3 centre(gridWidth / 2.0f, 0.0f, gridWidth / 2.0f);
+  int lightCount = std::min(scenario.lightCount, ammonite::lighting::getMaxLightCount());
+  if (lightCount != scenario.lightCount) {
+    std::cerr << "Scenario '" << scenario.name << "' limited to " << lightCount << " lights" << std::endl;
+  }
+
+  std::vector<int> lightIds(lightCount);
+  for (int i = 0; i < lightCount; i++) {
+    float angle = glm::two_pi<float>() * float(i) / float(lightCount);
+    lightIds[i] = ammonite::lighting::createLightSource();
+    ammonite::lighting::properties::setGeometry(lightIds[i],
+      centre + glm::vec3(std::sin(angle) * gridWidth / 2.0f, 4.0f, std::cos(angle) * gridWidth / 2.0f));
+    ammonite::lighting::properties::setPower(lightIds[i], 50.0f);
+  }
+  ammonite::lighting::updateLightSources();
+
+  //Warm up, then measure the same camera path every run
+  float radius = gridWidth * 0.75f + 5.0f;
+  ammonite::renderer::RenderStats renderStats;
+  double renderTotals[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  ammonite::utils::Timer wallTimer;
+  std::clock_t startCpuTime = 0;
+  for (int frame = -warmupFrames; success and frame < frameCount; frame++) {
+    if (frame == 0) {
+      ammonite::renderer::resetFrameStats();
+      ammonite::renderer::resetGpuTimes();
+      wallTimer.reset();
+      startCpuTime = std::clock();
+    }
+
+    placeCamera(std::max(frame, 0), frameCount, centre, radius);
+    ammonite::renderer::drawFrame(modelIds.data(), scenario.modelCount);
+    if (frame < 0) {
+      continue;
+    }
+
+    ammonite::renderer::getRenderStats(&renderStats);
+    renderTotals[0] += renderStats.drawCalls;
+    renderTotals[1] += renderStats.triangleCount;
+    renderTotals[2] += renderStats.textureBinds;
+    renderTotals[3] += renderStats.programSwitches;
+    renderTotals[4] += renderStats.bufferUploads;
+    renderTotals[5] += renderStats.uploadedBytes;
+  }
+
+  //Collect the results, averaging per frame counts
+  if (success) {
+    result->scenario = scenario;
+    result->uniqueMeshCount = uniqueMeshCount;
+    ammonite::renderer::getFrameStats(&result->frameStats);
+
+    //Process CPU time over wall time, above 1 when several threads are busy
+    double cpuTime = double(std::clock() - startCpuTime) / CLOCKS_PER_SEC;
+    result->cpuUsage = cpuTime / wallTimer.getTime();
+
+    //GPU times are read back a few frames late, so this covers all but the last few frames
+    ammonite::renderer::getMeanGpuPassTimes(&result->gpuPassTimes[0], &result->gpuPassTimes[1],
+                                            &result->gpuPassTimes[2], &result->gpuPassTimes[3]);
+
+    result->drawCalls = renderTotals[0] / frameCount;
+    result->triangles = renderTotals[1] / frameCount;
+    result->textureBinds = renderTotals[2] / frameCount;
+    result->programSwitches = renderTotals[3] / frameCount;
+    result->bufferUploads = renderTotals[4] / frameCount;
+    result->uploadedBytes = renderTotals[5] / frameCount;
+  }
+
+  //Clear the scene for the next scenario
+  for (unsigned int i = 0; i < lightIds.size(); i++) {
+    ammonite::lighting::deleteLightSource(lightIds[i]);
+  }
+  ammonite::lighting::updateLightSources();
+
+  for (unsigned int i = 0; i < modelIds.size(); i++) {
+    ammonite::models::deleteModel(modelIds[i]);
+  }
+
+  return success;
+}
+
+//Quote a string for JSON, escaping anything that would end it early
+static std::string jsonString(const char* value) {
+  std::string quoted = "\"";
+  for (const char* c = (value != nullptr) ? value : ""; *c != '\0'; c++) {
+    if (*c == '"' or *c == '\\') {
+      quoted += '\\';
+      quoted += *c;
+    } else if ((unsigned char)*c < 0x20) {
+      char escaped[7];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)*c);
+      quoted += escaped;
+    } else {
+      quoted += *c;
+    }
+  }
+
+  return quoted + "\"";
+}
+
+//JSON has no NaN or infinity, so measurements that couldn't be taken are written as null
+static std::string jsonNumber(double value) {
+  if (!std::isfinite(value)) {
+    return "null";
+  }
+
+  std::ostringstream number;
+  number << value;
+  return number.str();
+}
+
+static void writeResult(std::ostream* output, const ScenarioResult& result) {
+  const ammonite::renderer::FrameStats* stats = &result.frameStats;
+  const Scenario* scenario = &result.scenario;
+  *output << "    {\n"
+          << "      \"name\": " << jsonString(scenario->name.c_str()) << ",\n"
+          << "      \"models\": " << scenario->modelCount << ",\n"
+          << "      \"lights\": " << scenario->lightCount << ",\n"
+          << "      \"shadowRes\": " << scenario->shadowRes << ",\n"
+          << "      \"instancingRatio\": " << jsonNumber(scenario->instancingRatio) << ",\n"
+          << "      \"uniqueMeshes\": " << result.uniqueMeshCount << ",\n"
+          << "      \"frames\": " << stats->frameCount << ",\n"
+          << "      \"frameTimeMs\": {\"min\": " << jsonNumber(stats->minTime * 1000) << ", \"mean\": " << jsonNumber(stats->meanTime * 1000)
+          << ", \"p50\": " << jsonNumber(stats->p50Time * 1000) << ", \"p95\": " << jsonNumber(stats->p95Time * 1000)
+          << ", \"p99\": " << jsonNumber(stats->p99Time * 1000) << ", \"max\": " << jsonNumber(stats->maxTime * 1000) << "},\n"
+          << "      \"onePercentLowFps\": " << jsonNumber(stats->onePercentLow) << ",\n"
+          << "      \"cpuUsage\": " << jsonNumber(result.cpuUsage) << ",\n"
+          << "      \"gpuPassTimeMs\": {\"shadow\": " << jsonNumber(result.gpuPassTimes[0] * 1000)
+          << ", \"model\": " << jsonNumber(result.gpuPassTimes[1] * 1000) << ", \"emitter\": " << jsonNumber(result.gpuPassTimes[2] * 1000)
+          << ", \"skybox\": " << jsonNumber(result.gpuPassTimes[3] * 1000) << "},\n"
+          << "      \"perFrame\": {\"drawCalls\": " << result.drawCalls << ", \"triangles\": " << result.triangles
+          << ", \"textureBinds\": " << result.textureBinds << ", \"programSwitches\": " << result.programSwitches
+          << ", \"bufferUploads\": " << result.bufferUploads << ", \"uploadedBytes\": " << result.uploadedBytes << "}\n"
+          << "    }";
+}
+
+static void writeImportResult(std::ostream* output, const ImportResult& result) {
+  *output << "    {\"name\": " << jsonString(result.name.c_str()) << ", \"threads\": " << result.threadCount
+          << ", \"triangles\": " << result.triangleCount << ", \"meshes\": " << IMPORT_MESH_COUNT
+          << ", \"importTimeMs\": " << jsonNumber(result.importTime * 1000)
+          << ", \"trianglesPerSecond\": " << jsonNumber(result.triangleCount / result.importTime) << "}";
+}
+
+//Report per-call and per-model costs, in nanoseconds
+static void writeTransformResult(std::ostream* output, const TransformResult& result) {
+  double matrixTime = result.movingFrameTime - result.staticFrameTime;
+  *output << "  \"transforms\": {\"models\": " << result.modelCount << ", \"frames\": " << result.frameCount
+          << ", \"setPositionTotalMs\": " << jsonNumber(result.setPositionTime * 1000)
+          << ", \"setRotationTotalMs\": " << jsonNumber(result.setRotationTime * 1000)
+          << ", \"setPositionNs\": " << jsonNumber(result.setPositionTime * 1e9 / result.modelCount)
+          << ", \"setRotationNs\": " << jsonNumber(result.setRotationTime * 1e9 / result.modelCount)
+          << ", \"setPositionsBatchMs\": " << jsonNumber(result.setPositionsTime * 1000)
+          << ", \"setRotationsBatchMs\": " << jsonNumber(result.setRotationsTime * 1000)
+          << ", \"setPositionsNs\": " << jsonNumber(result.setPositionsTime * 1e9 / result.modelCount)
+          << ", \"setRotationsNs\": " << jsonNumber(result.setRotationsTime * 1e9 / result.modelCount)
+          << ", \"staticDrawFrameMs\": " << jsonNumber(result.staticFrameTime * 1000)
+          << ", \"movingDrawFrameMs\": " << jsonNumber(result.movingFrameTime * 1000)
+          << ", \"batchedDrawFrameMs\": " << jsonNumber(result.batchedFrameTime * 1000)
+          << ", \"matrixUpdateNs\": " << jsonNumber(matrixTime * 1e9 / result.modelCount) << "},\n";
+}
+
+static bool readIntArgument(int argc, char* argv[], const char* identifier, int* value) {
+  std::string argValue;
+  int found = arguments::searchArgument(argc, argv, identifier, false, &argValue);
+  if (found == -1) {
+    std::cout << identifier << " requires a value" << std::endl;
+    return false;
+  } else if (found == 1) {
+    *value = std::atoi(argValue.c_str());
+  }
+
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  //Handle arguments
+  const int showHelp = arguments::searchArgument(argc, argv, "--help", true, nullptr);
+  if (showHelp == 1) {
+    std::cout << "Program help: \n"
+    " --help:        Display this help page\n"
+    " --frames:      Frames to measure per scenario (default 300)\n"
+    " --warmup:      Frames to draw before measuring (default 30)\n"
+    " --width:       Framebuffer width (default 1280)\n"
+    " --height:      Framebuffer height (default 720)\n"
+    " --output:      Path to write the JSON report to (default stdout)\n"
+    " --models:      Run a single scenario with this many models, instead of the suite\n"
+    " --lights:      Light count for the single scenario (default 1)\n"
+    " --shadow-res:  Shadow resolution for the single scenario (default 1024)\n"
+    " --instancing:  Instancing ratio for the single scenario, 0 to 1 (default 0.5)\n"
+    " --import:      Triangles in the import model, 0 to skip importing (default 1000000)\n"
+    " --transforms:  Models moved each frame when timing transforms, 0 to skip (default 1024)" << std::endl;
+    return EXIT_SUCCESS;
+  } else if (showHelp == -1) {
+    return EXIT_FAILURE;
+  }
+
+  int frameCount = 300, warmupFrames = 30, width = 1280, height = 720;
+  int modelCount = 0, lightCount = 1, shadowRes = 1024, importTriangles = 1000000, transformModels = 1024;
+  std::string outputPath, instancingString;
+  if (!readIntArgument(argc, argv, "--frames", &frameCount) or
+      !readIntArgument(argc, argv, "--warmup", &warmupFrames) or
+      !readIntArgument(argc, argv, "--width", &width) or
+      !readIntArgument(argc, argv, "--height", &height) or
+      !readIntArgument(argc, argv, "--models", &modelCount) or
+      !readIntArgument(argc, argv, "--lights", &lightCount) or
+      !readIntArgument(argc, argv, "--shadow-res", &shadowRes) or
+      !readIntArgument(argc, argv, "--import", &importTriangles) or
+      !readIntArgument(argc, argv, "--transforms", &transformModels)) {
+    return EXIT_FAILURE;
+  }
+
+  if (arguments::searchArgument(argc, argv, "--output", false, &outputPath) == -1 or
+      arguments::searchArgument(argc, argv, "--instancing", false, &instancingString) == -1) {
+    std::cout << "--output and --instancing require a value" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (frameCount <= 0 or warmupFrames < 0 or width <= 0 or height <= 0) {
+    std::cout << "--frames, --width and --height must be positive" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  //Use the requested scenario, or sweep each parameter from a shared baseline
+  std::vector<Scenario> scenarios;
+  if (modelCount > 0) {
+    float instancingRatio = instancingString.empty() ? 0.5f : std::atof(instancingString.c_str());
+    scenarios.push_back({"custom", modelCount, lightCount, shadowRes, instancingRatio});
+  } else {
+    const int modelCounts[] = {1, 16, 64, 256};
+    for (int count : modelCounts) {
+      scenarios.push_back({"models-" + std::to_string(count), count, 1, 1024, 0.5f});
+    }
+
+    const int lightCounts[] = {2, 4};
+    for (int count : lightCounts) {
+      scenarios.push_back({"lights-" + std::to_string(count), 64, count, 1024, 0.5f});
+    }
+
+    const int shadowResolutions[] = {512, 2048};
+    for (int resolution : shadowResolutions) {
+      scenarios.push_back({"shadow-" + std::to_string(resolution), 64, 1, resolution, 0.5f});
+    }
+
+    const float instancingRatios[] = {0.0f, 0.9f};
+    for (float ratio : instancingRatios) {
+      scenarios.push_back({"instancing-" + std::to_string(int(ratio * 100)), 64, 1, 1024, ratio});
+    }
+  }
+
+  //Create a headless context, so the benchmark runs without a display
+  if (!ammonite::windowManager::setupHeadless(width, height)) {
+    return EXIT_FAILURE;
+  }
+
+  //Measure every frame as fast as possible
+  ammonite::settings::graphics::setVsync(false);
+  ammonite::settings::graphics::setFrameLimit(0.0f);
+  ammonite::settings::graphics::setGammaCorrection(true);
+  ammonite::lighting::setAmbientLight(glm::vec3(0.1f, 0.1f, 0.1f));
+
+  bool success = true;
+  ammonite::renderer::setup::setupRenderer(nullptr, "shaders/", &success);
+  if (!success) {
+    std::cerr << "Failed to initialise renderer, exiting" << std::endl;
+    ammonite::windowManager::destroyHeadless();
+    return EXIT_FAILURE;
+  }
+
+  //Generated meshes are kept between scenarios
+  std::error_code error;
+  std::string meshDirectory = (std::filesystem::temp_directory_path() / MESH_DIRECTORY).string();
+  std::filesystem::create_directories(meshDirectory, error);
+
+  //Measure import throughput before rendering anything
+  std::vector<ImportResult> importResults;
+  if (importTriangles > 0) {
+    std::cerr << "Importing " << importTriangles << " triangles" << std::endl;
+    if (!runImport(meshDirectory, importTriangles, &importResults)) {
+      std::cerr << "Import failed" << std::endl;
+      success = false;
+    }
+  }
+
+  //Measure the cost of moving models, before the scenarios
+  TransformResult transformResult;
+  bool hasTransformResult = false;
+  if (success and transformModels > 0) {
+    std::cerr << "Moving " << transformModels << " models" << std::endl;
+    hasTransformResult = runTransforms(meshDirectory, transformModels, warmupFrames,
+                                       frameCount, &transformResult);
+    if (!hasTransformResult) {
+      std::cerr << "Transform timing failed" << std::endl;
+      success = false;
+    }
+  }
+
+  std::vector<ScenarioResult> results;
+  for (unsigned int i = 0; success and i < scenarios.size(); i++) {
+    std::cerr << "Running '" << scenarios[i].name << "' (" << i + 1 << "/" << scenarios.size() << ")" << std::endl;
+
+    ScenarioResult result;
+    if (!runScenario(scenarios[i], meshDirectory, warmupFrames, frameCount, &result)) {
+      std::cerr << "Scenario '" << scenarios[i].name << "' failed" << std::endl;
+      success = false;
+      break;
+    }
+
+    results.push_back(result);
+  }
+
+  //Describe the driver, so results from different machines aren't mixed up
+  std::stringstream report;
+  report << "{\n"
+         << "  \"renderer\": " << jsonString((const char*)glGetString(GL_RENDERER)) << ",\n"
+         << "  \"version\": " << jsonString((const char*)glGetString(GL_VERSION)) << ",\n"
+         << "  \"width\": " << width << ",\n"
+         << "  \"height\": " << height << ",\n"
+         << "  \"warmupFrames\": " << warmupFrames << ",\n"
+         << "  \"imports\": [\n";
+  for (unsigned int i = 0; i < importResults.size(); i++) {
+    writeImportResult(&report, importResults[i]);
+    report << ((i + 1 < importResults.size()) ? ",\n" : "\n");
+  }
+  report << "  ],\n";
+  if (hasTransformResult) {
+    writeTransformResult(&report, transformResult);
+  }
+  report << "  \"scenarios\": [\n";
+  for (unsigned int i = 0; i < results.size(); i++) {
+    writeResult(&report, results[i]);
+    report << ((i + 1 < results.size()) ? ",\n" : "\n");
+  }
+  report << "  ]\n}\n";
+
+  if (outputPath.empty()) {
+    std::cout << report.str();
+  } else {
+    std::ofstream output(outputPath);
+    output << report.str();
+    output.close();
+    if (!output) {
+      std::cerr << "Failed to write '" << outputPath << "'" << std::endl;
+      success = false;
+    }
+  }
+
+  //Clean up and exit
+  ammonite::shaders::eraseShaders();
+  ammonite::windowManager::destroyHeadless();
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
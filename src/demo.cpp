@@ -19,6 +19,21 @@ void printMetrics(double frameTime) {
   std::printf(" (%fms)\n", frameTime * 1000);
 }
 
+void printFrameStats() {
+  ammonite::renderer::FrameStats stats;
+  ammonite::renderer::getFrameStats(&stats);
+
+  std::printf("  Frames: %li\n", stats.frameCount);
+  std::printf("  Frame times: min %.2fms, mean %.2fms, max %.2fms\n",
+              stats.minTime * 1000, stats.meanTime * 1000, stats.maxTime * 1000);
+  std::printf("  Percentiles: p50 %.2fms, p95 %.2fms, p99 %.2fms\n",
+              stats.p50Time * 1000, stats.p95Time * 1000, stats.p99Time * 1000);
+  std::printf("  1%% low: %.2f fps\n", stats.onePercentLow);
+  for (int i = 0; i < stats.thresholdCount; i++) {
+    std::printf("  Frames over %.2fms: %li\n", stats.thresholds[i] * 1000, stats.framesOverThreshold[i]);
+  }
+}
+
 void cleanUp(int modelCount, int loadedModelIds[]) {
   //Cleanup
   for (int i = 0; i < modelCount; i++) {
@@ -58,6 +73,22 @@ int main(int argc, char* argv[]) {
   //Set an icon
   ammonite::windowManager::useIconDir(window, "assets/icons/");
 
+  //Capture the startup and first frames to a trace, if requested
+  const char* tracePath = std::getenv("AMMONITE_TRACE");
+  if (tracePath != nullptr) {
+#ifdef PROFILE
+    int traceFrames = 300;
+    const char* traceFramesString = std::getenv("AMMONITE_TRACE_FRAMES");
+    if (traceFramesString != nullptr) {
+      traceFrames = std::atoi(traceFramesString);
+    }
+
+    ammonite::utils::profiler::startCapture(tracePath, traceFrames);
+#else
+    std::cerr << "AMMONITE_TRACE requires a build with PROFILE=true, ignoring" << std::endl;
+#endif
+  }
+
   //Set vsync (disable if benchmarking)
   if (useVsync == "false" or useBenchmark) {
     ammonite::settings::graphics::setVsync(false);
@@ -142,9 +173,10 @@ int main(int argc, char* argv[]) {
   ammonite::camera::setPosition(0, glm::vec3(0.0f, 0.0f, 5.0f));
   ammonite::camera::setPosition(cameraIds[1], glm::vec3(0.0f, 0.0f, 2.0f));
 
-  //Performance metrics setup
+  //Performance metrics setup, ignoring frames from loading
   ammonite::utils::Timer benchmarkTimer;
   performanceTimer.reset();
+  ammonite::renderer::resetFrameStats();
 
   //Draw frames until window closed
   while(ammonite::utils::controls::shouldWindowClose()) {
@@ -186,6 +218,7 @@ int main(int argc, char* argv[]) {
     std::cout << "\nBenchmark complete:" << std::endl;
     std::cout << "  Average fps: ";
     printMetrics(benchmarkTimer.getTime() / ammonite::renderer::getTotalFrames());
+    printFrameStats();
   }
 
   //Clean up and exit